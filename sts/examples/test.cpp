@@ -41,15 +41,17 @@ std::string get_instruction(ManeuverType type) {
   }
 }
 
+// message_template is a TTSEngine prompt template, "{}" is replaced by the
+// maneuver instruction
 void announce_stage(Maneuver &maneuver, const std::string &stage_name, 
-                   const std::string &message, TTSEngine &tts, STTStream &stt) {
+                   const std::string &message_template, TTSEngine &tts, STTStream &stt) {
   auto start = std::chrono::steady_clock::now();
   
   stt.pause();
   std::cout << "[" << stage_name << " - " 
             << std::fixed << std::setprecision(1) 
             << maneuver.distance_to_maneuver << "m] ";
-  tts.play(message);
+  tts.play_template(message_template, maneuver.instruction);
   
   auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
       std::chrono::steady_clock::now() - start).count();
@@ -80,12 +82,43 @@ int main() {
   std::cout << "Walking speed: " << WALKING_SPEED_MPS << " m/s" << std::endl;
   std::cout << "Demo speed: " << DEMO_SPEEDUP << "x\n" << std::endl;
   
+  // Fixed prompts come out of the phrase cache instead of piper
+  const char *TTS_CACHE_PATH = "tts_phrase_cache.bin";
+  tts.load_cache(TTS_CACHE_PATH);
+  std::vector<std::string> phrases = {
+    "Navigation assistant ready. Say Start navigation to begin.",
+    "Navigation started. Proceeding to destination.",
+    "Navigation resumed.",
+    "Navigation is already active.",
+    "Navigation paused. Say Start navigation to resume.",
+    "Navigation is not active.",
+    "Navigation stopped. Goodbye!",
+    "Navigation complete. You have reached your destination."
+  };
+  // template fragments and slot values are cached separately
+  phrases.push_back("In 5 seconds,");
+  phrases.push_back("Prepare to");
+  phrases.push_back("now");
+  for (const Maneuver &maneuver : route) {
+    phrases.push_back(maneuver.instruction);
+  }
+  tts.prewarm(phrases);
+  tts.save_cache(TTS_CACHE_PATH);
+
   stt.pause();
   tts.play("Navigation assistant ready. Say Start navigation to begin.");
   stt.resume();
   
-  while (true) {
-    std::string transcription = stt.start_listening();
+  // Whisper decodes on its own thread so the maneuver timer below keeps
+  // ticking while a transcription is in flight
+  stt.start_async();
+
+  while (!stt.quit_requested()) {
+    STTResult result;
+    std::string transcription;
+    if (stt.wait_pop(result, 50)) {
+      transcription = result.text;
+    }
     auto command_time = std::chrono::steady_clock::now();
     
     if (stt.listen_for(transcription, "Start navigation")) {
@@ -161,7 +194,7 @@ int main() {
       
       if (!maneuver.early_announced && maneuver.distance_to_maneuver <= early_threshold) {
         announce_stage(maneuver, "EARLY SIGNAL", 
-                     "In 5 seconds, " + maneuver.instruction, tts, stt);
+                     "In 5 seconds, {}", tts, stt);
         maneuver.early_announced = true;
         maneuver.early_announce_time = std::chrono::steady_clock::now();
       }
@@ -172,7 +205,7 @@ int main() {
         
         if (time_since_early >= 3.0 && maneuver.distance_to_maneuver <= prepare_threshold) {
           announce_stage(maneuver, "PREPARE STAGE", 
-                       "Prepare to " + maneuver.instruction, tts, stt);
+                       "Prepare to {}", tts, stt);
           maneuver.prepare_announced = true;
           maneuver.prepare_announce_time = std::chrono::steady_clock::now();
         }
@@ -184,7 +217,7 @@ int main() {
         
         if (time_since_prepare >= 2.0 && maneuver.distance_to_maneuver <= commit_threshold) {
           announce_stage(maneuver, "COMMIT STAGE", 
-                       maneuver.instruction + " now", tts, stt);
+                       "{} now", tts, stt);
           maneuver.commit_announced = true;
           
           current_maneuver_index++;
@@ -0,0 +1,163 @@
+// Compares the recursive fft() whisper.cpp used for the mel spectrogram with
+// the planned real FFT in whisper-fft.h, one frame at a time and in batches.
+//
+// usage: stt_bench_fft [frames]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "whisper-fft.h"
+
+#define N_FFT 400
+#define SIN_COS_N_COUNT N_FFT
+
+using clock_type = std::chrono::steady_clock;
+
+static double ms_since(clock_type::time_point start) {
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+}
+
+// The previous implementation, as it was in whisper.cpp
+static float sin_vals[SIN_COS_N_COUNT];
+static float cos_vals[SIN_COS_N_COUNT];
+
+static void dft(const float* in, int N, float* out) {
+    const int sin_cos_step = SIN_COS_N_COUNT / N;
+
+    for (int k = 0; k < N; k++) {
+        float re = 0;
+        float im = 0;
+
+        for (int n = 0; n < N; n++) {
+            int idx = (k * n * sin_cos_step) % (SIN_COS_N_COUNT);
+            re += in[n]*cos_vals[idx];
+            im -= in[n]*sin_vals[idx];
+        }
+
+        out[k*2 + 0] = re;
+        out[k*2 + 1] = im;
+    }
+}
+
+static void fft(float* in, int N, float* out) {
+    if (N == 1) {
+        out[0] = in[0];
+        out[1] = 0;
+        return;
+    }
+
+    const int half_N = N / 2;
+    if (N - half_N*2 == 1) {
+        dft(in, N, out);
+        return;
+    }
+
+    float* even = in + N;
+    for (int i = 0; i < half_N; ++i) {
+        even[i]= in[2*i];
+    }
+    float* even_fft = out + 2 * N;
+    fft(even, half_N, even_fft);
+
+    float* odd = even;
+    for (int i = 0; i < half_N; ++i) {
+        odd[i] = in[2*i + 1];
+    }
+    float* odd_fft = even_fft + N;
+    fft(odd, half_N, odd_fft);
+
+    const int sin_cos_step = SIN_COS_N_COUNT / N;
+    for (int k = 0; k < half_N; k++) {
+        int idx = k * sin_cos_step;
+        float re = cos_vals[idx];
+        float im = -sin_vals[idx];
+
+        float re_odd = odd_fft[2*k + 0];
+        float im_odd = odd_fft[2*k + 1];
+
+        out[2*k + 0] = even_fft[2*k + 0] + re*re_odd - im*im_odd;
+        out[2*k + 1] = even_fft[2*k + 1] + re*im_odd + im*re_odd;
+
+        out[2*(k + half_N) + 0] = even_fft[2*k + 0] - re*re_odd + im*im_odd;
+        out[2*(k + half_N) + 1] = even_fft[2*k + 1] - re*im_odd - im*re_odd;
+    }
+}
+
+int main(int argc, char ** argv) {
+    // 30 s of audio at a 10 ms hop
+    const int n_frames = argc > 1 ? std::max(8, atoi(argv[1])) : 3000;
+    const int n_bins   = N_FFT/2 + 1;
+    const int batch    = 8;
+
+    for (int i = 0; i < SIN_COS_N_COUNT; i++) {
+        double theta = (2 * M_PI * i) / SIN_COS_N_COUNT;
+        sin_vals[i] = sinf(theta);
+        cos_vals[i] = cosf(theta);
+    }
+
+    whisper_rfft_plan plan;
+    if (!whisper_rfft_plan_init(plan, N_FFT)) {
+        fprintf(stderr, "Failed to plan a real FFT of %d\n", N_FFT);
+        return 1;
+    }
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<float> frames((size_t) n_frames * N_FFT);
+    for (auto & x : frames) {
+        x = dist(rng);
+    }
+
+    std::vector<float> out_old((size_t) n_frames * 2 * n_bins);
+    std::vector<float> out_single(out_old.size());
+    std::vector<float> out_batch(out_old.size());
+
+    // the old path needs scratch space past the input and output, as in log_mel_frame
+    std::vector<float> fft_in(N_FFT * 2);
+    std::vector<float> fft_out(N_FFT * 2 * 2 * 2);
+    std::vector<float> work(whisper_rfft_work_size(plan, batch));
+
+    auto start = clock_type::now();
+    for (int f = 0; f < n_frames; f++) {
+        std::copy(frames.begin() + (size_t) f * N_FFT, frames.begin() + (size_t) (f + 1) * N_FFT, fft_in.begin());
+        fft(fft_in.data(), N_FFT, fft_out.data());
+        std::copy(fft_out.begin(), fft_out.begin() + 2 * n_bins, out_old.begin() + (size_t) f * 2 * n_bins);
+    }
+    const double t_old = ms_since(start);
+
+    start = clock_type::now();
+    for (int f = 0; f < n_frames; f++) {
+        whisper_rfft<1>(plan, frames.data() + (size_t) f * N_FFT, N_FFT, out_single.data() + (size_t) f * 2 * n_bins, 0, work.data());
+    }
+    const double t_single = ms_since(start);
+
+    start = clock_type::now();
+    int f = 0;
+    for (; f + batch <= n_frames; f += batch) {
+        whisper_rfft<8>(plan, frames.data() + (size_t) f * N_FFT, N_FFT, out_batch.data() + (size_t) f * 2 * n_bins, 2 * n_bins, work.data());
+    }
+    for (; f < n_frames; f++) {
+        whisper_rfft<1>(plan, frames.data() + (size_t) f * N_FFT, N_FFT, out_batch.data() + (size_t) f * 2 * n_bins, 0, work.data());
+    }
+    const double t_batch = ms_since(start);
+
+    double err_single = 0.0;
+    double err_batch  = 0.0;
+    double peak       = 0.0;
+    for (size_t i = 0; i < out_old.size(); i++) {
+        err_single = std::max(err_single, (double) std::fabs(out_single[i] - out_old[i]));
+        err_batch  = std::max(err_batch,  (double) std::fabs(out_batch[i]  - out_old[i]));
+        peak       = std::max(peak,       (double) std::fabs(out_old[i]));
+    }
+
+    printf("%d frames of %d samples\n", n_frames, N_FFT);
+    printf("%-12s %9.2fms %8.2fus/frame\n", "recursive", t_old,    1e3 * t_old    / n_frames);
+    printf("%-12s %9.2fms %8.2fus/frame  max err %.2e\n", "planned",   t_single, 1e3 * t_single / n_frames, err_single / peak);
+    printf("%-12s %9.2fms %8.2fus/frame  max err %.2e\n", "planned x8", t_batch,  1e3 * t_batch  / n_frames, err_batch  / peak);
+    printf("speedup      %9.2fx (single) %.2fx (batch)\n", t_old / t_single, t_old / t_batch);
+
+    return 0;
+}
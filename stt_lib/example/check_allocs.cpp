@@ -0,0 +1,177 @@
+// Checks that STTStream's steady-state step does no heap allocations.
+//
+// Global operator new/delete are replaced with counting versions. The stream
+// runs in asynchronous mode with a callback; after the warm-up results the
+// count is reset and must still be zero after the measured ones. whisper_full()
+// is linked through --wrap and its internal allocations are not counted, the
+// rest of the step (capture, VAD, window bookkeeping, prompt, result text and
+// delivery) is. Speak while it runs: results are only produced for speech.
+//
+// usage: stt_check_allocs [steps] [warmup] [--utterance]
+#include "stt_lib.hpp"
+#include "whisper.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+static std::atomic<size_t> g_n_new{0};
+static std::atomic<size_t> g_n_delete{0};
+
+// > 0 while the current thread is inside whisper_full()
+static thread_local int t_excluded = 0;
+
+static void * counted_alloc(size_t size) {
+    if (t_excluded == 0) {
+        g_n_new++;
+    }
+    void * ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+static void * counted_alloc_aligned(size_t size, std::align_val_t al) {
+    if (t_excluded == 0) {
+        g_n_new++;
+    }
+    void * ptr = nullptr;
+    if (posix_memalign(&ptr, std::max(sizeof(void *), (size_t) al), size ? size : 1) != 0) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+static void counted_free(void * ptr) {
+    if (ptr && t_excluded == 0) {
+        g_n_delete++;
+    }
+    free(ptr);
+}
+
+void * operator new(size_t size)                                              { return counted_alloc(size); }
+void * operator new[](size_t size)                                            { return counted_alloc(size); }
+void * operator new(size_t size, std::align_val_t al)                         { return counted_alloc_aligned(size, al); }
+void * operator new[](size_t size, std::align_val_t al)                       { return counted_alloc_aligned(size, al); }
+void * operator new(size_t size, const std::nothrow_t &) noexcept             { try { return counted_alloc(size); } catch (...) { return nullptr; } }
+void * operator new[](size_t size, const std::nothrow_t &) noexcept           { try { return counted_alloc(size); } catch (...) { return nullptr; } }
+void * operator new(size_t size, std::align_val_t al, const std::nothrow_t &) noexcept   { try { return counted_alloc_aligned(size, al); } catch (...) { return nullptr; } }
+void * operator new[](size_t size, std::align_val_t al, const std::nothrow_t &) noexcept { try { return counted_alloc_aligned(size, al); } catch (...) { return nullptr; } }
+
+void operator delete(void * ptr) noexcept                                     { counted_free(ptr); }
+void operator delete[](void * ptr) noexcept                                   { counted_free(ptr); }
+void operator delete(void * ptr, size_t) noexcept                             { counted_free(ptr); }
+void operator delete[](void * ptr, size_t) noexcept                           { counted_free(ptr); }
+void operator delete(void * ptr, std::align_val_t) noexcept                   { counted_free(ptr); }
+void operator delete[](void * ptr, std::align_val_t) noexcept                 { counted_free(ptr); }
+void operator delete(void * ptr, size_t, std::align_val_t) noexcept           { counted_free(ptr); }
+void operator delete[](void * ptr, size_t, std::align_val_t) noexcept         { counted_free(ptr); }
+void operator delete(void * ptr, const std::nothrow_t &) noexcept             { counted_free(ptr); }
+void operator delete[](void * ptr, const std::nothrow_t &) noexcept           { counted_free(ptr); }
+void operator delete(void * ptr, std::align_val_t, const std::nothrow_t &) noexcept   { counted_free(ptr); }
+void operator delete[](void * ptr, std::align_val_t, const std::nothrow_t &) noexcept { counted_free(ptr); }
+
+// stt_lib's calls to whisper_full() land here (-Wl,--wrap=whisper_full)
+extern "C" int __real_whisper_full(struct whisper_context * ctx, struct whisper_full_params params, const float * samples, int n_samples);
+
+extern "C" int __wrap_whisper_full(struct whisper_context * ctx, struct whisper_full_params params, const float * samples, int n_samples) {
+    t_excluded++;
+    const int ret = __real_whisper_full(ctx, params, samples, n_samples);
+    t_excluded--;
+    return ret;
+}
+
+int main(int argc, char ** argv) {
+    int n_steps   = 10;
+    int n_warmup  = 3;
+    bool utterance = false;
+
+    int n_pos = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--utterance") == 0) {
+            utterance = true;
+        } else if (n_pos++ == 0) {
+            n_steps = std::max(1, atoi(argv[i]));
+        } else {
+            n_warmup = std::max(1, atoi(argv[i]));
+        }
+    }
+
+    STTStream stream;
+    if (!stream.is_initialized()) {
+        fprintf(stderr, "Failed to initialize the stream\n");
+        return 1;
+    }
+
+    stream.set_utterance_mode(utterance);
+
+    // runs on the worker thread as part of the step, so it must not allocate either
+    std::atomic<int> n_results{0};
+    stream.set_callback([&](const STTResult & result) {
+        fprintf(stderr, "  [%2d] %4lldms %s\n", n_results.load(), (long long) result.latency_ms, result.text.c_str());
+        n_results++;
+    });
+
+    if (!stream.start_async()) {
+        fprintf(stderr, "Failed to start the stream\n");
+        return 1;
+    }
+
+    // waits until n results have been delivered, gives up after timeout_s without one
+    const auto wait_results = [&](int n, int timeout_s) {
+        int last = n_results.load();
+        auto t_last = std::chrono::steady_clock::now();
+        while (n_results.load() < n && !stream.quit_requested()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            if (n_results.load() != last) {
+                last = n_results.load();
+                t_last = std::chrono::steady_clock::now();
+            } else if (std::chrono::steady_clock::now() - t_last > std::chrono::seconds(timeout_s)) {
+                return false;
+            }
+        }
+        return n_results.load() >= n;
+    };
+
+    fprintf(stderr, "%s mode, speak now: %d warm-up and %d measured steps\n",
+            utterance ? "utterance" : "sliding window", n_warmup, n_steps);
+
+    if (!wait_results(n_warmup, 30)) {
+        stream.stop_async();
+        fprintf(stderr, "No speech detected during warm-up\n");
+        return 1;
+    }
+
+    const int    n_begin      = n_results.load();
+    const size_t n_new_begin  = g_n_new.load();
+    const size_t n_del_begin  = g_n_delete.load();
+
+    const bool complete = wait_results(n_begin + n_steps, 30);
+
+    const int    n_measured = n_results.load() - n_begin;
+    const size_t n_new      = g_n_new.load()    - n_new_begin;
+    const size_t n_del      = g_n_delete.load() - n_del_begin;
+
+    stream.stop_async();
+
+    printf("%d steps, %zu allocations, %zu frees (excluding whisper_full)\n", n_measured, n_new, n_del);
+
+    if (!complete) {
+        fprintf(stderr, "Only %d of %d steps were measured\n", n_measured, n_steps);
+        return 1;
+    }
+
+    if (n_new != 0) {
+        fprintf(stderr, "FAILED: the steady-state step allocated\n");
+        return 1;
+    }
+
+    printf("OK\n");
+
+    return 0;
+}
@@ -1,6 +1,13 @@
 #include "common-sdl.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
+
+void audio_view::copy_to(float * dst) const {
+    memcpy(dst,      data0, n0*sizeof(float));
+    memcpy(dst + n0, data1, n1*sizeof(float));
+}
 
 audio_async::audio_async(int len_ms) {
     m_len_ms = len_ms;
@@ -12,6 +19,10 @@ audio_async::~audio_async() {
     if (m_dev_id_in) {
         SDL_CloseAudioDevice(m_dev_id_in);
     }
+
+    if (m_sem) {
+        SDL_DestroySemaphore(m_sem);
+    }
 }
 
 bool audio_async::init(int capture_id, int sample_rate) {
@@ -68,7 +79,23 @@ bool audio_async::init(int capture_id, int sample_rate) {
 
     m_sample_rate = capture_spec_obtained.freq;
 
-    m_audio.resize((m_sample_rate*m_len_ms)/1000);
+    m_audio_len = (m_sample_rate*m_len_ms)/1000;
+
+    size_t n_ring = 1;
+    while (n_ring < 2*m_audio_len) {
+        n_ring <<= 1;
+    }
+
+    m_audio.assign(n_ring, 0.0f);
+    m_audio_mask = n_ring - 1;
+    m_write_pos  = 0;
+    m_clear_pos  = 0;
+
+    m_sem = SDL_CreateSemaphore(0);
+    if (!m_sem) {
+        fprintf(stderr, "%s: couldn't create the capture semaphore: %s!\n", __func__, SDL_GetError());
+        return false;
+    }
 
     return true;
 }
@@ -120,12 +147,8 @@ bool audio_async::clear() {
         return false;
     }
 
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-
-        m_audio_pos = 0;
-        m_audio_len = 0;
-    }
+    // the callback keeps writing - just forget everything captured so far
+    m_clear_pos.store(m_write_pos.load(std::memory_order_acquire), std::memory_order_release);
 
     return true;
 }
@@ -138,27 +161,34 @@ void audio_async::callback(uint8_t * stream, int len) {
 
     size_t n_samples = len / sizeof(float);
 
-    if (n_samples > m_audio.size()) {
-        n_samples = m_audio.size();
+    if (n_samples > m_audio_len) {
+        n_samples = m_audio_len;
 
         stream += (len - (n_samples * sizeof(float)));
     }
 
-    //fprintf(stderr, "%s: %zu samples, pos %zu, len %zu\n", __func__, n_samples, m_audio_pos, m_audio_len);
+    //fprintf(stderr, "%s: %zu samples, pos %zu\n", __func__, n_samples, (size_t) m_write_pos.load());
 
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
+    const uint64_t pos = m_write_pos.load(std::memory_order_relaxed);
+    const size_t   s0  = pos & m_audio_mask;
 
-        if (m_audio_pos + n_samples > m_audio.size()) {
-            const size_t n0 = m_audio.size() - m_audio_pos;
+    if (s0 + n_samples > m_audio.size()) {
+        const size_t n0 = m_audio.size() - s0;
 
-            memcpy(&m_audio[m_audio_pos], stream, n0 * sizeof(float));
-            memcpy(&m_audio[0], stream + n0 * sizeof(float), (n_samples - n0) * sizeof(float));
-        } else {
-            memcpy(&m_audio[m_audio_pos], stream, n_samples * sizeof(float));
-        }
-        m_audio_pos = (m_audio_pos + n_samples) % m_audio.size();
-        m_audio_len = std::min(m_audio_len + n_samples, m_audio.size());
+        memcpy(&m_audio[s0], stream, n0 * sizeof(float));
+        memcpy(&m_audio[0], stream + n0 * sizeof(float), (n_samples - n0) * sizeof(float));
+    } else {
+        memcpy(&m_audio[s0], stream, n_samples * sizeof(float));
+    }
+
+    // publish the new samples to the readers
+    // seq_cst store + load pair with the ones in wait_for() so that either the reader sees the
+    // new position or the callback sees the armed threshold
+    m_write_pos.store(pos + n_samples);
+
+    uint64_t notify_pos = m_notify_pos.load();
+    if (pos + n_samples >= notify_pos && m_notify_pos.compare_exchange_strong(notify_pos, UINT64_MAX)) {
+        SDL_SemPost(m_sem);
     }
 }
 
@@ -173,35 +203,96 @@ void audio_async::get(int ms, std::vector<float> & result) {
         return;
     }
 
-    result.clear();
+    const audio_view v = view(ms);
 
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
+    result.resize(v.size());
+    v.copy_to(result.data());
+}
 
-        if (ms <= 0) {
-            ms = m_len_ms;
-        }
+uint64_t audio_async::position() const {
+    return m_write_pos.load(std::memory_order_acquire);
+}
 
-        size_t n_samples = (m_sample_rate * ms) / 1000;
-        if (n_samples > m_audio_len) {
-            n_samples = m_audio_len;
-        }
+audio_view audio_async::make_view(uint64_t pos_begin, uint64_t pos_end) const {
+    audio_view result;
 
-        result.resize(n_samples);
+    result.pos = pos_begin;
 
-        int s0 = m_audio_pos - n_samples;
-        if (s0 < 0) {
-            s0 += m_audio.size();
-        }
+    if (pos_end <= pos_begin) {
+        return result;
+    }
 
-        if (s0 + n_samples > m_audio.size()) {
-            const size_t n0 = m_audio.size() - s0;
+    const size_t n_samples = pos_end - pos_begin;
+    const size_t s0        = pos_begin & m_audio_mask;
 
-            memcpy(result.data(), &m_audio[s0], n0 * sizeof(float));
-            memcpy(&result[n0], &m_audio[0], (n_samples - n0) * sizeof(float));
-        } else {
-            memcpy(result.data(), &m_audio[s0], n_samples * sizeof(float));
-        }
+    result.data0 = &m_audio[s0];
+    result.n0    = std::min(n_samples, m_audio.size() - s0);
+    result.data1 = &m_audio[0];
+    result.n1    = n_samples - result.n0;
+
+    return result;
+}
+
+audio_view audio_async::view(int ms) const {
+    if (ms <= 0) {
+        ms = m_len_ms;
+    }
+
+    const uint64_t pos_end = position();
+    const size_t   n_want  = std::min((size_t) (m_sample_rate * ms) / 1000, m_audio_len);
+
+    return view_since(pos_end > n_want ? pos_end - n_want : 0);
+}
+
+audio_view audio_async::view_since(uint64_t pos, size_t max_samples) const {
+    const uint64_t pos_end    = position();
+    const uint64_t pos_oldest = pos_end > m_audio_len ? pos_end - m_audio_len : 0;
+
+    pos = std::max(pos, std::max(pos_oldest, m_clear_pos.load(std::memory_order_acquire)));
+
+    if (max_samples > 0 && pos_end > pos + max_samples) {
+        return make_view(pos, pos + max_samples);
+    }
+
+    return make_view(pos, pos_end);
+}
+
+bool audio_async::is_valid(const audio_view & v) const {
+    // the producer may be writing up to m_audio_len samples past position()
+    return position() + m_audio_len <= v.pos + m_audio.size();
+}
+
+bool audio_async::wait_for(uint64_t pos, size_t n_samples, int timeout_ms) {
+    const uint64_t pos_target = pos + n_samples;
+
+    if (m_write_pos.load() >= pos_target) {
+        return true;
+    }
+
+    if (!m_sem) {
+        return false;
+    }
+
+    // drop wakeups left over from an earlier wait, a pending wake() is kept in m_wake
+    while (SDL_SemTryWait(m_sem) == 0) {
+    }
+
+    m_notify_pos.store(pos_target);
+
+    // the threshold may have been crossed, or wake() called, before it was armed
+    if (m_write_pos.load() < pos_target && !m_wake.exchange(false)) {
+        SDL_SemWaitTimeout(m_sem, timeout_ms);
+    }
+
+    m_notify_pos.store(UINT64_MAX);
+
+    return m_write_pos.load() >= pos_target;
+}
+
+void audio_async::wake() {
+    if (m_sem) {
+        m_wake.store(true);
+        SDL_SemPost(m_sem);
     }
 }
 
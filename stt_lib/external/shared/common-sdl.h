@@ -4,14 +4,33 @@
 #include <SDL_audio.h>
 
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <vector>
-#include <mutex>
 
 //
 // SDL Audio capture
 //
 
+// zero-copy view into the capture ring buffer
+// the window may wrap around the end of the ring, so the samples are
+// [data0, data0 + n0) followed by [data1, data1 + n1)
+struct audio_view {
+    const float * data0 = nullptr;
+    size_t        n0    = 0;
+    const float * data1 = nullptr;
+    size_t        n1    = 0;
+
+    // absolute capture position of the first sample in the view
+    uint64_t pos = 0;
+
+    size_t   size() const { return n0 + n1; }
+    uint64_t end()  const { return pos + n0 + n1; }
+
+    // copy the (unwrapped) samples to dst, which must hold size() floats
+    void copy_to(float * dst) const;
+};
+
 class audio_async {
 public:
     audio_async(int len_ms);
@@ -31,18 +50,57 @@ public:
     // get audio data from the circular buffer
     void get(int ms, std::vector<float> & audio);
 
+    // total number of samples captured so far
+    // positions only ever grow, so they can be used as read cursors
+    uint64_t position() const;
+
+    // view of the last ms of audio (ms <= 0 - the whole len_ms window)
+    audio_view view(int ms) const;
+
+    // view of the samples captured since position pos, at most max_samples (0 - no limit)
+    // pos is clamped to the oldest sample still retained and to the last clear()
+    audio_view view_since(uint64_t pos, size_t max_samples = 0) const;
+
+    // a view stays readable until the producer wraps around onto it, which
+    // takes at least len_ms after it was taken - returns false once that happened
+    bool is_valid(const audio_view & view) const;
+
+    // block until n_samples have been captured past position pos, or until timeout_ms expires
+    // returns true if the samples are available
+    // the callback signals once when the threshold is crossed, so a waiting reader is
+    // not woken up for every SDL buffer
+    bool wait_for(uint64_t pos, size_t n_samples, int timeout_ms);
+
+    // wake up a thread blocked in wait_for() early
+    // a wake() that arrives before the wait starts makes the next wait_for() return at once
+    void wake();
+
 private:
+    audio_view make_view(uint64_t pos_begin, uint64_t pos_end) const;
+
     SDL_AudioDeviceID m_dev_id_in = 0;
 
     int m_len_ms = 0;
     int m_sample_rate = 0;
 
     std::atomic_bool m_running;
-    std::mutex       m_mutex;
 
-    std::vector<float> m_audio;
-    size_t             m_audio_pos = 0;
-    size_t             m_audio_len = 0;
+    // single-producer/single-consumer ring: only the SDL callback stores
+    // m_write_pos, readers never block it
+    // the ring holds twice the len_ms window so that views have time to be read
+    std::vector<float>    m_audio;
+    size_t                m_audio_mask = 0;
+    size_t                m_audio_len  = 0; // len_ms in samples
+    std::atomic<uint64_t> m_write_pos{0};
+    std::atomic<uint64_t> m_clear_pos{0};
+
+    // position at which the callback has to post m_sem (UINT64_MAX - nobody is waiting)
+    std::atomic<uint64_t> m_notify_pos{UINT64_MAX};
+    SDL_sem *             m_sem = nullptr;
+
+    // set by wake() until a wait_for() consumes it, so the post is not lost with the stale ones
+    // (a wake() racing with the end of a wait makes at most one later wait return early)
+    std::atomic_bool      m_wake{false};
 };
 
 // Return false if need to quit
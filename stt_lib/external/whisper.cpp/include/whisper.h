@@ -286,6 +286,27 @@ extern "C" {
                                int   n_samples,
                                int   n_threads);
 
+    // Same as whisper_pcm_to_mel_with_state(), for audio that is a window of a continuous stream
+    // with samples[0] at stream_pos. The raw columns of frames that lie entirely inside the audio
+    // are cached in the state by stream position, and later windows that overlap only transform
+    // the frames they have not seen before; the normalization is redone for every window.
+    // Windows must start at multiples of WHISPER_HOP_LENGTH apart for their frames to line up,
+    // and a stream position must always refer to the same sample (call whisper_mel_stream_reset()
+    // when positions start over). stream_pos < 0 disables the cache.
+    // Returns 0 on success
+    WHISPER_API int whisper_pcm_to_mel_stream_with_state(
+            struct whisper_context * ctx,
+              struct whisper_state * state,
+                       const float * samples,
+                               int   n_samples,
+                           int64_t   stream_pos,
+                               int   n_threads);
+
+    // Drops the cached mel columns (and conv stem columns, see whisper_full_params.conv_cache)
+    // of the default state / the given state
+    WHISPER_API void whisper_mel_stream_reset(struct whisper_context * ctx);
+    WHISPER_API void whisper_mel_stream_reset_with_state(struct whisper_state * state);
+
     // This can be used to set a custom log mel spectrogram inside the default state of the provided whisper context.
     // Use this instead of whisper_pcm_to_mel() if you want to provide your own log mel spectrogram.
     // n_mel must be 80
@@ -514,6 +535,19 @@ extern "C" {
         bool debug_mode;        // enable debug_mode provides extra info (eg. Dump log_mel)
         int  audio_ctx;         // overwrite the audio context size (0 = use default)
 
+        // position of samples[0] in a continuous audio stream, or -1
+        // when set, mel columns computed by earlier calls on the same state are reused for the
+        // same stream positions, so a sliding window only transforms its new audio
+        // see whisper_pcm_to_mel_stream_with_state()
+        int64_t stream_pos;
+
+        // [EXPERIMENTAL] reuse the encoder conv stem output for audio the previous window of the
+        // stream already covered (needs stream_pos), so only the new columns go through the stem;
+        // the transformer layers still run over the whole window
+        // every conv_cache_resync-th encode after a reuse recomputes the stem in full (0 = never)
+        bool conv_cache;
+        int  conv_cache_resync;
+
         // [EXPERIMENTAL] [TDRZ] tinydiarize
         bool tdrz_enable;       // enable tinydiarize speaker turn detection
 
@@ -718,6 +752,47 @@ extern "C" {
     WHISPER_API void whisper_vad_free_segments(struct whisper_vad_segments * segments);
     WHISPER_API void whisper_vad_free         (struct whisper_vad_context  * ctx);
 
+    // Streaming VAD
+    //
+    // whisper_vad_detect_speech() resets the LSTM state and processes the whole buffer on every call.
+    // The streaming functions below instead keep the LSTM hidden/cell state and the samples that do
+    // not fill a whole window yet between calls, so feeding new audio costs O(new samples).
+    // Do not mix them with whisper_vad_detect_speech() on the same context without a reset.
+
+    enum whisper_vad_event_type {
+        WHISPER_VAD_EVENT_SPEECH_START = 0,
+        WHISPER_VAD_EVENT_SPEECH_END   = 1,
+    };
+
+    typedef struct whisper_vad_event {
+        enum whisper_vad_event_type type;
+        int64_t t_sample; // position in the stream (samples pushed since the last reset), including speech_pad_ms
+    } whisper_vad_event;
+
+    // Reset the stream. Speech start/end events follow the threshold, min_speech_duration_ms,
+    // min_silence_duration_ms and speech_pad_ms fields of params:
+    //   - start: speech lasted for min_speech_duration_ms
+    //   - end:   silence lasted for min_silence_duration_ms
+    WHISPER_API void whisper_vad_stream_reset(struct whisper_vad_context * vctx, struct whisper_vad_params params);
+
+    // Process new samples. Returns the number of new windows (probabilities) or -1 on failure.
+    WHISPER_API int whisper_vad_stream_push(
+            struct whisper_vad_context * vctx,
+                           const float * samples,
+                                   int   n_samples);
+
+    // Results of the last whisper_vad_stream_push() call
+    WHISPER_API int                      whisper_vad_stream_n_probs  (struct whisper_vad_context * vctx);
+    WHISPER_API const float *            whisper_vad_stream_probs    (struct whisper_vad_context * vctx);
+    WHISPER_API int                      whisper_vad_stream_n_events (struct whisper_vad_context * vctx);
+    WHISPER_API struct whisper_vad_event whisper_vad_stream_get_event(struct whisper_vad_context * vctx, int i_event);
+
+    // True between a speech start event and the matching end event
+    WHISPER_API bool whisper_vad_stream_in_speech(struct whisper_vad_context * vctx);
+
+    // Number of samples per VAD window (512 for Silero)
+    WHISPER_API int whisper_vad_n_window(struct whisper_vad_context * vctx);
+
     ////////////////////////////////////////////////////////////////////////////
 
     // Temporary helpers needed for exposing ggml interface
@@ -0,0 +1,247 @@
+#pragma once
+
+// Planned real FFT for the log mel spectrogram
+//
+// A real FFT of even length n is done as a complex FFT of length m = n/2 over
+// z[i] = x[2i] + i*x[2i + 1], followed by a split step that separates the even
+// and odd halves again. The complex FFT is a Stockham autosort (no bit
+// reversal) over the factors of m with radix 4, 2 and 5 butterflies, so the
+// whisper frame (n = 400, m = 200 = 4*2*5*5) needs four passes. All twiddles
+// are computed when the plan is made; a transform does no allocations and no
+// trig calls.
+//
+// The data is kept as separate real and imaginary arrays with the frames of a
+// batch interleaved ([element][frame]). Every butterfly then runs over
+// stride*B contiguous floats with the same twiddle, which the compiler turns
+// into AVX2/NEON code without intrinsics. B = 1 transforms a single frame.
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+struct whisper_rfft_plan {
+    struct pass {
+        int radix;
+        int len;    // length of the sub-transforms at this pass
+        int stride; // number of interleaved sub-transforms
+        int tw;     // offset of the pass twiddles W_len^(j*k) in tw_re/tw_im, [k][j - 1]
+    };
+
+    int n = 0; // real length
+    int m = 0; // complex length, n/2
+
+    std::vector<pass>  passes;
+    std::vector<float> tw_re;
+    std::vector<float> tw_im;
+
+    // W_n^k, k = 0..m, for the split step
+    std::vector<float> split_re;
+    std::vector<float> split_im;
+};
+
+// returns false if n is odd or n/2 has prime factors other than 2 and 5
+static bool whisper_rfft_plan_init(whisper_rfft_plan & plan, int n) {
+    if (n < 2 || n % 2 != 0) {
+        return false;
+    }
+
+    plan = whisper_rfft_plan();
+    plan.n = n;
+    plan.m = n/2;
+
+    int len    = plan.m;
+    int stride = 1;
+    while (len > 1) {
+        int radix = 0;
+        if (len % 4 == 0) {
+            radix = 4;
+        } else if (len % 2 == 0) {
+            radix = 2;
+        } else if (len % 5 == 0) {
+            radix = 5;
+        } else {
+            return false;
+        }
+
+        const int sub = len/radix;
+        plan.passes.push_back({ radix, len, stride, (int) plan.tw_re.size() });
+        for (int k = 0; k < sub; k++) {
+            for (int j = 1; j < radix; j++) {
+                const double theta = -2.0*M_PI*j*k/len;
+                plan.tw_re.push_back(cos(theta));
+                plan.tw_im.push_back(sin(theta));
+            }
+        }
+
+        len     = sub;
+        stride *= radix;
+    }
+
+    for (int k = 0; k <= plan.m; k++) {
+        const double theta = -2.0*M_PI*k/n;
+        plan.split_re.push_back(cos(theta));
+        plan.split_im.push_back(sin(theta));
+    }
+
+    return true;
+}
+
+// floats of workspace needed by whisper_rfft for a batch of `batch` frames
+static size_t whisper_rfft_work_size(const whisper_rfft_plan & plan, int batch) {
+    return 4*(size_t) plan.m*batch;
+}
+
+// one Stockham pass: y[q + s*(p*k + j)] = W_len^(j*k) * DFT_p(x[q + s*(k + r*len/p)])_j
+// the q loop runs over the interleaved sub-transforms times the batch, sb = stride*B floats
+static void whisper_rfft_pass(const whisper_rfft_plan & plan, const whisper_rfft_plan::pass & ps, int batch,
+                              const float * xr, const float * xi, float * yr, float * yi) {
+    const int p   = ps.radix;
+    const int sub = ps.len/p;
+    const int sb  = ps.stride*batch;
+
+    const float * twr = plan.tw_re.data() + ps.tw;
+    const float * twi = plan.tw_im.data() + ps.tw;
+
+    for (int k = 0; k < sub; k++) {
+        const float * ar[5];
+        const float * ai[5];
+        float * br[5];
+        float * bi[5];
+        for (int r = 0; r < p; r++) {
+            ar[r] = xr + (size_t) (k + r*sub)*sb;
+            ai[r] = xi + (size_t) (k + r*sub)*sb;
+            br[r] = yr + (size_t) (p*k + r)*sb;
+            bi[r] = yi + (size_t) (p*k + r)*sb;
+        }
+
+        const float * w_re = twr + k*(p - 1);
+        const float * w_im = twi + k*(p - 1);
+
+        switch (p) {
+            case 2:
+                {
+                    const float w1r = w_re[0], w1i = w_im[0];
+                    for (int q = 0; q < sb; q++) {
+                        const float dr = ar[0][q] - ar[1][q];
+                        const float di = ai[0][q] - ai[1][q];
+                        br[0][q] = ar[0][q] + ar[1][q];
+                        bi[0][q] = ai[0][q] + ai[1][q];
+                        br[1][q] = dr*w1r - di*w1i;
+                        bi[1][q] = dr*w1i + di*w1r;
+                    }
+                } break;
+            case 4:
+                {
+                    const float w1r = w_re[0], w1i = w_im[0];
+                    const float w2r = w_re[1], w2i = w_im[1];
+                    const float w3r = w_re[2], w3i = w_im[2];
+                    for (int q = 0; q < sb; q++) {
+                        const float t0r = ar[0][q] + ar[2][q], t0i = ai[0][q] + ai[2][q];
+                        const float t1r = ar[0][q] - ar[2][q], t1i = ai[0][q] - ai[2][q];
+                        const float t2r = ar[1][q] + ar[3][q], t2i = ai[1][q] + ai[3][q];
+                        const float t3r = ar[1][q] - ar[3][q], t3i = ai[1][q] - ai[3][q];
+
+                        // b1 = t1 - i*t3, b3 = t1 + i*t3
+                        const float c1r = t1r + t3i, c1i = t1i - t3r;
+                        const float c2r = t0r - t2r, c2i = t0i - t2i;
+                        const float c3r = t1r - t3i, c3i = t1i + t3r;
+
+                        br[0][q] = t0r + t2r;
+                        bi[0][q] = t0i + t2i;
+                        br[1][q] = c1r*w1r - c1i*w1i;
+                        bi[1][q] = c1r*w1i + c1i*w1r;
+                        br[2][q] = c2r*w2r - c2i*w2i;
+                        bi[2][q] = c2r*w2i + c2i*w2r;
+                        br[3][q] = c3r*w3r - c3i*w3i;
+                        bi[3][q] = c3r*w3i + c3i*w3r;
+                    }
+                } break;
+            case 5:
+                {
+                    const float c1 =  0.309016994374947424f; //  cos(2pi/5)
+                    const float c2 = -0.809016994374947424f; //  cos(4pi/5)
+                    const float s1 =  0.951056516295153572f; //  sin(2pi/5)
+                    const float s2 =  0.587785252292473129f; //  sin(4pi/5)
+                    for (int q = 0; q < sb; q++) {
+                        const float t1r = ar[1][q] + ar[4][q], t1i = ai[1][q] + ai[4][q];
+                        const float t2r = ar[2][q] + ar[3][q], t2i = ai[2][q] + ai[3][q];
+                        const float t3r = ar[1][q] - ar[4][q], t3i = ai[1][q] - ai[4][q];
+                        const float t4r = ar[2][q] - ar[3][q], t4i = ai[2][q] - ai[3][q];
+
+                        const float t5r = ar[0][q] + c1*t1r + c2*t2r, t5i = ai[0][q] + c1*t1i + c2*t2i;
+                        const float t6r = ar[0][q] + c2*t1r + c1*t2r, t6i = ai[0][q] + c2*t1i + c1*t2i;
+                        const float t7r = s1*t3r + s2*t4r, t7i = s1*t3i + s2*t4i;
+                        const float t8r = s2*t3r - s1*t4r, t8i = s2*t3i - s1*t4i;
+
+                        // b1 = t5 - i*t7, b4 = t5 + i*t7, b2 = t6 - i*t8, b3 = t6 + i*t8
+                        const float d1r = t5r + t7i, d1i = t5i - t7r;
+                        const float d4r = t5r - t7i, d4i = t5i + t7r;
+                        const float d2r = t6r + t8i, d2i = t6i - t8r;
+                        const float d3r = t6r - t8i, d3i = t6i + t8r;
+
+                        br[0][q] = ar[0][q] + t1r + t2r;
+                        bi[0][q] = ai[0][q] + t1i + t2i;
+                        br[1][q] = d1r*w_re[0] - d1i*w_im[0];
+                        bi[1][q] = d1r*w_im[0] + d1i*w_re[0];
+                        br[2][q] = d2r*w_re[1] - d2i*w_im[1];
+                        bi[2][q] = d2r*w_im[1] + d2i*w_re[1];
+                        br[3][q] = d3r*w_re[2] - d3i*w_im[2];
+                        bi[3][q] = d3r*w_im[2] + d3i*w_re[2];
+                        br[4][q] = d4r*w_re[3] - d4i*w_im[3];
+                        bi[4][q] = d4r*w_im[3] + d4i*w_re[3];
+                    }
+                } break;
+        }
+    }
+}
+
+// real FFT of B frames of plan.n samples, frame b read from in + b*in_stride
+// writes bins 0..n/2 as interleaved (re, im) to out + b*out_stride
+// work must hold whisper_rfft_work_size(plan, B) floats
+template <int B>
+static void whisper_rfft(const whisper_rfft_plan & plan, const float * in, int in_stride,
+                         float * out, int out_stride, float * work) {
+    const int m = plan.m;
+
+    float * xr = work;
+    float * xi = xr + m*B;
+    float * yr = xi + m*B;
+    float * yi = yr + m*B;
+
+    for (int e = 0; e < m; e++) {
+        for (int b = 0; b < B; b++) {
+            xr[e*B + b] = in[b*in_stride + 2*e + 0];
+            xi[e*B + b] = in[b*in_stride + 2*e + 1];
+        }
+    }
+
+    for (const auto & ps : plan.passes) {
+        whisper_rfft_pass(plan, ps, B, xr, xi, yr, yi);
+        std::swap(xr, yr);
+        std::swap(xi, yi);
+    }
+
+    // X[k] = E[k] + W_n^k*O[k] with E[k] = (Z[k] + conj(Z[m - k]))/2, O[k] = (Z[k] - conj(Z[m - k]))/2i
+    for (int k = 0; k <= m; k++) {
+        const int k0 = k % m;
+        const int k1 = (m - k) % m;
+        const float wr = plan.split_re[k];
+        const float wi = plan.split_im[k];
+        for (int b = 0; b < B; b++) {
+            const float zr  = xr[k0*B + b], zi  = xi[k0*B + b];
+            const float zcr = xr[k1*B + b], zci = -xi[k1*B + b];
+
+            const float er = 0.5f*(zr + zcr);
+            const float ei = 0.5f*(zi + zci);
+            const float or_ = 0.5f*(zi - zci);
+            const float oi  = -0.5f*(zr - zcr);
+
+            out[b*out_stride + 2*k + 0] = er + wr*or_ - wi*oi;
+            out[b*out_stride + 2*k + 1] = ei + wr*oi  + wi*or_;
+        }
+    }
+}
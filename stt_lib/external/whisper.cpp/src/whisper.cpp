@@ -1,5 +1,6 @@
 #include "whisper.h"
 #include "whisper-arch.h"
+#include "whisper-fft.h"
 
 #include "ggml.h"
 #include "ggml-cpp.h"
@@ -21,12 +22,14 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <climits>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <functional>
 #include <map>
+#include <mutex>
 #include <random>
 #include <regex>
 #include <set>
@@ -416,16 +419,185 @@ struct whisper_mel {
     int n_len_org;
     int n_mel;
 
+    // stream position of the audio the mel was computed from, -1 if unknown
+    int64_t stream_pos = -1;
+
     std::vector<float> data;
 };
 
+// raw (log10, not normalized) mel columns cached by stream position
+// see whisper_pcm_to_mel_stream_with_state()
+struct whisper_mel_stream {
+    // 30 s of frames plus room for the ones that straddle the window edges
+    static constexpr int n_slots = 3000 + 64;
+
+    int n_mel = 0;
+
+    std::vector<int64_t> center; // stream position of the frame center in each slot, -1 = empty
+    std::vector<float>   data;   // [n_slots][n_mel]
+
+    void reset(int n_mel_new) {
+        n_mel = n_mel_new;
+        center.assign(n_slots, -1);
+        data.assign((size_t) n_slots*n_mel, 0.0f);
+    }
+};
+
+// Threads kept alive across calls, so that per-call work such as the mel spectrogram does not
+// create and join threads every time. run(n, fn) calls fn(0) .. fn(n - 1), fn(0) on the calling
+// thread, and returns when all of them are done. Idle threads sleep on a condition variable.
+struct whisper_worker_pool {
+    ~whisper_worker_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv_start.notify_all();
+        for (auto & thread : threads) {
+            thread.join();
+        }
+    }
+
+    void run(int n, const std::function<void(int)> & fn) {
+        if (n > 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            while ((int) threads.size() < n - 1) {
+                const int ith = threads.size() + 1;
+                threads.emplace_back(&whisper_worker_pool::worker, this, ith, generation);
+            }
+            job       = &fn;
+            n_tasks   = n;
+            n_pending = n - 1;
+            generation++;
+            cv_start.notify_all();
+        }
+
+        fn(0);
+
+        if (n > 1) {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv_done.wait(lock, [&] { return n_pending == 0; });
+            job = nullptr;
+        }
+    }
+
+private:
+    void worker(int ith, uint64_t seen) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv_start.wait(lock, [&] { return stop || generation != seen; });
+            if (stop) {
+                return;
+            }
+            seen = generation;
+            if (ith >= n_tasks) {
+                continue;
+            }
+
+            const auto * fn = job;
+            lock.unlock();
+            (*fn)(ith);
+            lock.lock();
+
+            if (--n_pending == 0) {
+                cv_done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex               mutex;
+    std::condition_variable  cv_start;
+    std::condition_variable  cv_done;
+
+    const std::function<void(int)> * job = nullptr;
+
+    uint64_t generation = 0;
+    int      n_tasks    = 0;
+    int      n_pending  = 0;
+    bool     stop       = false;
+};
+
+// [EXPERIMENTAL] conv stem output of the last encoded window, see whisper_full_params.conv_cache
+//
+// Column t of the stem output depends on mel columns 2t-2 .. 2t+2 only. When those are all
+// frames inside the audio (no reflective or zero padding, no graph edge) the column is the same
+// in every window that contains that stretch of the stream, except for the clamping of the
+// normalization: columns are reused only if none of their mel values is at or below either
+// window's floor, or both windows have the same floor.
+struct whisper_conv_cache {
+    // previous window
+    int64_t col0  = -1;   // stream position of its column 0 in stem columns (2 hops), -1 = none
+    int     n_ctx = 0;
+    int     lo    = 0;    // its columns [lo, hi) are reusable
+    int     hi    = 0;
+    float   floor = 0.0f; // its smallest normalized mel value
+
+    std::vector<float> data; // [n_state][n_ctx]
+
+    // current window, set by whisper_conv_cache_plan(); reused columns are [reuse_begin, reuse_end)
+    int64_t cur_col0    = -1;
+    int     cur_lo      = 0;
+    int     cur_hi      = 0;
+    float   cur_floor   = 0.0f;
+    int     reuse_begin = 0;
+    int     reuse_end   = 0;
+
+    std::vector<float> reuse;  // [n_state][reuse_end - reuse_begin]
+    std::vector<float> colmin; // smallest mel value of each window column
+
+    int n_reused = 0; // encodes that reused columns since the last full one
+
+    void reset() {
+        col0        = -1;
+        cur_col0    = -1;
+        reuse_begin = 0;
+        reuse_end   = 0;
+        n_reused    = 0;
+    }
+};
+
 struct whisper_filters {
     int32_t n_mel;
     int32_t n_fft;
 
     std::vector<float> data;
+
+    // Banded copy of data: filter j is non-zero only on bins band_start[j] .. band_start[j] + band_width[j] - 1,
+    // its weights for those bins are packed in band_data from band_offset[j]
+    std::vector<int32_t> band_start;
+    std::vector<int32_t> band_width;
+    std::vector<int32_t> band_offset;
+    std::vector<float>   band_data;
 };
 
+static void whisper_filters_init_bands(whisper_filters & filters) {
+    filters.band_start.assign(filters.n_mel, 0);
+    filters.band_width.assign(filters.n_mel, 0);
+    filters.band_offset.assign(filters.n_mel, 0);
+    filters.band_data.clear();
+
+    for (int j = 0; j < filters.n_mel; j++) {
+        const float * row = filters.data.data() + (size_t) j*filters.n_fft;
+
+        int first = filters.n_fft;
+        int last  = -1;
+        for (int k = 0; k < filters.n_fft; k++) {
+            if (row[k] != 0.0f) {
+                first = std::min(first, k);
+                last  = k;
+            }
+        }
+
+        filters.band_offset[j] = filters.band_data.size();
+        if (last >= first) {
+            filters.band_start[j] = first;
+            filters.band_width[j] = last - first + 1;
+            filters.band_data.insert(filters.band_data.end(), row + first, row + last + 1);
+        }
+    }
+}
+
 struct whisper_vocab {
     using id    = int32_t;
     using token = std::string;
@@ -861,6 +1033,10 @@ struct whisper_state {
     whisper_kv_cache kv_pad;
 
     whisper_mel mel;
+    whisper_mel_stream mel_stream;
+
+    // log_mel_spectrogram workers
+    whisper_worker_pool mel_pool;
 
     whisper_batch batch;
 
@@ -920,6 +1096,10 @@ struct whisper_state {
     // [EXPERIMENTAL] speed-up techniques
     int32_t exp_n_audio_ctx = 0; // 0 - use default
 
+    bool    exp_conv_cache        = false;
+    int32_t exp_conv_cache_resync = 0;
+    whisper_conv_cache conv_cache;
+
     whisper_vad_context * vad_context = nullptr;
 
     struct vad_segment_info {
@@ -1583,6 +1763,8 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
         filters.data.resize(filters.n_mel * filters.n_fft);
         loader->read(loader->context, filters.data.data(), filters.data.size() * sizeof(float));
         BYTESWAP_FILTERS(filters);
+
+        whisper_filters_init_bands(filters);
     }
 
     // load vocab
@@ -1973,6 +2155,41 @@ static bool whisper_encode_external(const whisper_state & wstate) {
     return use_coreml || use_openvino;
 }
 
+// convolution + gelu
+static struct ggml_tensor * whisper_conv_stem(
+        struct ggml_context * ctx0,
+        const whisper_model & model,
+        struct ggml_tensor  * mel) {
+    struct ggml_tensor * cur = ggml_conv_1d_ph(ctx0, model.e_conv_1_w, mel, 1, 1);
+    cur = ggml_add(ctx0, cur, model.e_conv_1_b);
+
+    cur = ggml_gelu(ctx0, cur);
+
+    cur = ggml_conv_1d_ph(ctx0, model.e_conv_2_w, cur, 2, 1);
+    cur = ggml_add(ctx0, cur, model.e_conv_2_b);
+
+    cur = ggml_gelu(ctx0, cur);
+
+    return cur;
+}
+
+// stem output columns [t0, t1) of the window, computed from only the mel columns they depend on
+static struct ggml_tensor * whisper_conv_stem_cols(
+        struct ggml_context * ctx0,
+        const whisper_model & model,
+        struct ggml_tensor  * mel,
+                        int   t0,
+                        int   t1) {
+    const int m0 = std::max<int>(0, 2*t0 - 2);
+    const int m1 = std::min<int>(mel->ne[0], 2*t1 + 2);
+
+    struct ggml_tensor * part = ggml_cont(ctx0, ggml_view_2d(ctx0, mel, m1 - m0, mel->ne[1], mel->nb[1], m0*mel->nb[0]));
+    struct ggml_tensor * cur  = whisper_conv_stem(ctx0, model, part);
+
+    // column 0 of the part is column m0/2 of the window, the one before t0 sees the cut
+    return ggml_cont(ctx0, ggml_view_2d(ctx0, cur, t1 - t0, cur->ne[1], cur->nb[1], (t0 - m0/2)*cur->nb[0]));
+}
+
 static struct ggml_cgraph * whisper_build_graph_conv(
         whisper_context & wctx,
           whisper_state & wstate) {
@@ -2001,17 +2218,18 @@ static struct ggml_cgraph * whisper_build_graph_conv(
     struct ggml_tensor * cur = nullptr;
 
     if (!whisper_encode_external(wstate)) {
-        // convolution + gelu
-        {
-            cur = ggml_conv_1d_ph(ctx0, model.e_conv_1_w, mel, 1, 1);
-            cur = ggml_add(ctx0, cur, model.e_conv_1_b);
-
-            cur = ggml_gelu(ctx0, cur);
+        const auto & cc = wstate.conv_cache;
 
-            cur = ggml_conv_1d_ph(ctx0, model.e_conv_2_w, cur, 2, 1);
-            cur = ggml_add(ctx0, cur, model.e_conv_2_b);
+        if (cc.reuse_end > cc.reuse_begin) {
+            // [EXPERIMENTAL] conv cache: the reused columns are an input, only the rest go through the stem
+            struct ggml_tensor * reuse = ggml_new_tensor_2d(ctx0, GGML_TYPE_F32, cc.reuse_end - cc.reuse_begin, n_state);
+            ggml_set_name(reuse, "conv_reuse");
+            ggml_set_input(reuse);
 
-            cur = ggml_gelu(ctx0, cur);
+            cur = ggml_concat(ctx0, whisper_conv_stem_cols(ctx0, model, mel, 0, cc.reuse_begin), reuse, 0);
+            cur = ggml_concat(ctx0, cur, whisper_conv_stem_cols(ctx0, model, mel, cc.reuse_end, n_ctx), 0);
+        } else {
+            cur = whisper_conv_stem(ctx0, model, mel);
         }
 
         ggml_set_name(cur, "embd_conv");
@@ -2355,6 +2573,104 @@ static struct ggml_cgraph * whisper_build_graph_cross(
 //   - n_threads:  number of threads to use
 //   - mel_offset: offset in the mel spectrogram (i.e. audio offset)
 //
+// [EXPERIMENTAL] find the stem columns of the window at mel_offset that the previous window
+// already computed and gather them into conv_cache.reuse
+static void whisper_conv_cache_plan(whisper_state & wstate, int mel_offset, int n_ctx, int n_state) {
+    auto & cc = wstate.conv_cache;
+    const auto & mel = wstate.mel;
+
+    cc.cur_col0    = -1;
+    cc.reuse_begin = 0;
+    cc.reuse_end   = 0;
+
+    if (!wstate.exp_conv_cache || whisper_encode_external(wstate) || mel.stream_pos < 0 || mel.stream_pos % WHISPER_HOP_LENGTH != 0) {
+        return;
+    }
+
+    // the stem has stride 2, windows whose first mel column is odd do not line up
+    const int64_t mel_col0 = mel.stream_pos/WHISPER_HOP_LENGTH + mel_offset;
+    if (mel_col0 % 2 != 0) {
+        return;
+    }
+
+    // columns whose mel columns 2t-2 .. 2t+2 are all inside the window and are frames of the audio
+    // proper: mel frame i sees the reflective padding for i < 2 and the zero padding for i >= n_len_org
+    cc.cur_col0 = mel_col0/2;
+    cc.cur_lo   = std::max(1, (4 - mel_offset + 1)/2);
+    cc.cur_hi   = mel.n_len_org - 3 - mel_offset >= 0 ? std::min(n_ctx - 1, (mel.n_len_org - 3 - mel_offset)/2 + 1) : 0;
+
+    cc.colmin.assign(2*n_ctx, FLT_MAX);
+    cc.cur_floor = FLT_MAX;
+    for (int j = 0; j < mel.n_mel; ++j) {
+        for (int i = mel_offset; i < std::min(mel_offset + 2*n_ctx, mel.n_len); ++i) {
+            const float v = mel.data[j*mel.n_len + i];
+            cc.colmin[i - mel_offset] = std::min(cc.colmin[i - mel_offset], v);
+            cc.cur_floor = std::min(cc.cur_floor, v);
+        }
+    }
+
+    if (cc.col0 < 0 || cc.cur_hi <= cc.cur_lo) {
+        return;
+    }
+
+    if (wstate.exp_conv_cache_resync > 0 && cc.n_reused >= wstate.exp_conv_cache_resync) {
+        return;
+    }
+
+    const float floor_max = std::max(cc.floor, cc.cur_floor);
+
+    int t = cc.cur_lo;
+    for (; t < cc.cur_hi; ++t) {
+        const int64_t t_prev = t + cc.cur_col0 - cc.col0;
+        if (t_prev < cc.lo || t_prev >= cc.hi) {
+            break;
+        }
+
+        if (cc.floor != cc.cur_floor) {
+            const float v = *std::min_element(cc.colmin.begin() + 2*t - 2, cc.colmin.begin() + 2*t + 3);
+            if (v <= floor_max) {
+                break;
+            }
+        }
+    }
+
+    if (t == cc.cur_lo) {
+        return;
+    }
+
+    cc.reuse_begin = cc.cur_lo;
+    cc.reuse_end   = t;
+
+    const int     n_reuse = cc.reuse_end - cc.reuse_begin;
+    const int64_t shift   = cc.cur_col0 - cc.col0;
+
+    cc.reuse.resize((size_t) n_state*n_reuse);
+    for (int s = 0; s < n_state; ++s) {
+        memcpy(cc.reuse.data() + (size_t) s*n_reuse, cc.data.data() + (size_t) s*cc.n_ctx + cc.reuse_begin + shift, n_reuse*sizeof(float));
+    }
+}
+
+// [EXPERIMENTAL] keep the stem output of the window that was just encoded for the next one
+static void whisper_conv_cache_store(whisper_state & wstate, int n_ctx) {
+    auto & cc = wstate.conv_cache;
+
+    if (cc.cur_col0 < 0) {
+        cc.reset();
+        return;
+    }
+
+    cc.n_reused = cc.reuse_end > cc.reuse_begin ? cc.n_reused + 1 : 0;
+
+    cc.col0  = cc.cur_col0;
+    cc.n_ctx = n_ctx;
+    cc.lo    = cc.cur_lo;
+    cc.hi    = cc.cur_hi;
+    cc.floor = cc.cur_floor;
+
+    cc.data.resize(ggml_nelements(wstate.embd_conv));
+    ggml_backend_tensor_get(wstate.embd_conv, cc.data.data(), 0, ggml_nbytes(wstate.embd_conv));
+}
+
 static bool whisper_encode_internal(
         whisper_context & wctx,
           whisper_state & wstate,
@@ -2368,6 +2684,11 @@ static bool whisper_encode_internal(
     {
         auto & sched = wstate.sched_conv.sched;
 
+        const int n_ctx   = wstate.exp_n_audio_ctx > 0 ? wstate.exp_n_audio_ctx : wctx.model.hparams.n_audio_ctx;
+        const int n_state = wctx.model.hparams.n_audio_state;
+
+        whisper_conv_cache_plan(wstate, mel_offset, n_ctx, n_state);
+
         ggml_cgraph * gf = whisper_build_graph_conv(wctx, wstate);
 
         if (!ggml_backend_sched_alloc_graph(sched, gf)) {
@@ -2380,7 +2701,6 @@ static bool whisper_encode_internal(
         // set the input
         {
             const auto & mel_inp = wstate.mel;
-            const int n_ctx      = wstate.exp_n_audio_ctx > 0 ? wstate.exp_n_audio_ctx : wctx.model.hparams.n_audio_ctx;
 
             assert(mel->type == GGML_TYPE_F32);
             assert(mel_inp.n_mel == wctx.model.hparams.n_mels);
@@ -2402,10 +2722,19 @@ static bool whisper_encode_internal(
             ggml_backend_tensor_set(mel, wstate.inp_mel.data(), 0, ggml_nelements(mel)*sizeof(float));
         }
 
+        if (wstate.conv_cache.reuse_end > wstate.conv_cache.reuse_begin) {
+            struct ggml_tensor * reuse = ggml_graph_get_tensor(gf, "conv_reuse");
+            ggml_backend_tensor_set(reuse, wstate.conv_cache.reuse.data(), 0, ggml_nbytes(reuse));
+        }
+
         if (!whisper_encode_external(wstate)) {
             if (!ggml_graph_compute_helper(sched, gf, n_threads)) {
                 return false;
             }
+
+            if (wstate.exp_conv_cache) {
+                whisper_conv_cache_store(wstate, n_ctx);
+            }
         } else {
             ggml_backend_sched_reset(sched);
 
@@ -2994,30 +3323,19 @@ static std::string to_timestamp(int64_t t, bool comma = false) {
     return std::string(buf);
 }
 
-#define SIN_COS_N_COUNT WHISPER_N_FFT
 namespace {
 struct whisper_global_cache {
-    // In FFT, we frequently use sine and cosine operations with the same values.
-    // We can use precalculated values to speed up the process.
-    float sin_vals[SIN_COS_N_COUNT];
-    float cos_vals[SIN_COS_N_COUNT];
-
     // Hann window (Use cosf to eliminate difference)
     // ref: https://pytorch.org/docs/stable/generated/torch.hann_window.html
     // ref: https://github.com/openai/whisper/blob/main/whisper/audio.py#L147
     float hann_window[WHISPER_N_FFT];
 
+    // twiddles of the frame FFT
+    whisper_rfft_plan rfft;
+
     whisper_global_cache() {
-        fill_sin_cos_table();
         fill_hann_window(sizeof(hann_window)/sizeof(hann_window[0]), true, hann_window);
-    }
-
-    void fill_sin_cos_table() {
-        for (int i = 0; i < SIN_COS_N_COUNT; i++) {
-            double theta = (2 * M_PI * i) / SIN_COS_N_COUNT;
-            sin_vals[i] = sinf(theta);
-            cos_vals[i] = cosf(theta);
-        }
+        whisper_rfft_plan_init(rfft, WHISPER_N_FFT);
     }
 
     void fill_hann_window(int length, bool periodic, float * output) {
@@ -3032,134 +3350,157 @@ struct whisper_global_cache {
 } global_cache;
 }
 
-// naive Discrete Fourier Transform
-// input is real-valued
-// output is complex-valued
-static void dft(const float* in, int N, float* out) {
-    const int sin_cos_step = SIN_COS_N_COUNT / N;
-
-    for (int k = 0; k < N; k++) {
-        float re = 0;
-        float im = 0;
-
-        for (int n = 0; n < N; n++) {
-            int idx = (k * n * sin_cos_step) % (SIN_COS_N_COUNT); // t = 2*M_PI*k*n/N
-            re += in[n]*global_cache.cos_vals[idx]; // cos(t)
-            im -= in[n]*global_cache.sin_vals[idx]; // sin(t)
-        }
-
-        out[k*2 + 0] = re;
-        out[k*2 + 1] = im;
-    }
-}
+// frames the mel workers pass through the FFT together
+#define WHISPER_MEL_FFT_BATCH 8
 
-// Cooley-Tukey FFT
-// poor man's implementation - use something better
-// input is real-valued
-// output is complex-valued
-static void fft(float* in, int N, float* out) {
-    if (N == 1) {
-        out[0] = in[0];
-        out[1] = 0;
-        return;
-    }
+// Hann window a frame of frame_size samples, of which n_avail are available, into dst
+static void log_mel_window(const float * hann, const float * frame, int n_avail, int frame_size, float * dst) {
+    const int n = std::min(frame_size, n_avail);
 
-    const int half_N = N / 2;
-    if (N - half_N*2 == 1) {
-        dft(in, N, out);
-        return;
+    // apply Hann window (~10% faster)
+    for (int j = 0; j < n; j++) {
+        dst[j] = hann[j] * frame[j];
     }
 
-    float* even = in + N;
-    for (int i = 0; i < half_N; ++i) {
-        even[i]= in[2*i];
-    }
-    float* even_fft = out + 2 * N;
-    fft(even, half_N, even_fft);
+    // fill the rest with zeros
+    std::fill(dst + n, dst + frame_size, 0.0f);
+}
 
-    float* odd = even;
-    for (int i = 0; i < half_N; ++i) {
-        odd[i] = in[2*i + 1];
+// power spectra of frames b = 0 .. B-1 (interleaved complex bins, frame b from spectrum + b*stride)
+// into power[k*B + b]
+static void log_mel_power(const float * spectrum, int stride, int B, int n_fft, float * power) {
+    for (int b = 0; b < B; b++) {
+        const float * s = spectrum + b * stride;
+        // Calculate modulus^2 of complex numbers
+        // Use pow(s[2 * k + 0], 2) + pow(s[2 * k + 1], 2) causes inference quality problem? Interesting.
+        for (int k = 0; k < n_fft; k++) {
+            power[k * B + b] = (s[2 * k + 0] * s[2 * k + 0] + s[2 * k + 1] * s[2 * k + 1]);
+        }
     }
-    float* odd_fft = even_fft + N;
-    fft(odd, half_N, odd_fft);
-
-    const int sin_cos_step = SIN_COS_N_COUNT / N;
-    for (int k = 0; k < half_N; k++) {
-        int idx = k * sin_cos_step; // t = 2*M_PI*k/N
-        float re = global_cache.cos_vals[idx]; // cos(t)
-        float im = -global_cache.sin_vals[idx]; // sin(t)
+}
 
-        float re_odd = odd_fft[2*k + 0];
-        float im_odd = odd_fft[2*k + 1];
+// log mel columns out[b][0 .. n_mel-1] of B frames from their power spectra power[k*B + b]
+// a small GEMM over the filter bands: each filter only reads its own bins, the frames are the vector lanes
+template <int B>
+static void log_mel_bands(const float * power, const whisper_filters & filters, int n_mel, float * const * out) {
+    for (int j = 0; j < n_mel; j++) {
+        const float * w = filters.band_data.data() + filters.band_offset[j];
+        const float * p = power + (size_t) filters.band_start[j] * B;
+        const int     n = filters.band_width[j];
 
-        out[2*k + 0] = even_fft[2*k + 0] + re*re_odd - im*im_odd;
-        out[2*k + 1] = even_fft[2*k + 1] + re*im_odd + im*re_odd;
+        float sum[B] = {};
+        for (int k = 0; k < n; k++) {
+            for (int b = 0; b < B; b++) {
+                sum[b] += w[k] * p[k * B + b];
+            }
+        }
 
-        out[2*(k + half_N) + 0] = even_fft[2*k + 0] - re*re_odd + im*im_odd;
-        out[2*(k + half_N) + 1] = even_fft[2*k + 1] - re*im_odd - im*re_odd;
+        for (int b = 0; b < B; b++) {
+            out[b][j] = log10f(std::max(sum[b], 1e-10f));
+        }
     }
 }
 
 static void log_mel_spectrogram_worker_thread(int ith, const float * hann, const std::vector<float> & samples,
                                               int n_samples, int frame_size, int frame_step, int n_threads,
-                                              const whisper_filters & filters, whisper_mel & mel) {
-    std::vector<float> fft_in(frame_size * 2, 0.0);
-    std::vector<float> fft_out(frame_size * 2 * 2 * 2);
+                                              const whisper_filters & filters, whisper_mel & mel,
+                                              whisper_mel_stream * stream, int64_t stream_pos) {
+    constexpr int n_batch_max = WHISPER_MEL_FFT_BATCH;
+
+    const whisper_rfft_plan & plan = global_cache.rfft;
+    const int n_spectrum = 2 * filters.n_fft;
 
-    int n_fft = filters.n_fft;
-    int i = ith;
+    std::vector<float> fft_in(n_batch_max * frame_size);
+    std::vector<float> fft_out(n_batch_max * n_spectrum);
+    std::vector<float> fft_work(whisper_rfft_work_size(plan, n_batch_max));
+    std::vector<float> power(n_batch_max * filters.n_fft);
+    std::vector<float> columns(n_batch_max * mel.n_mel);
+
+    // windowed frames waiting for the FFT and where their log mel goes
+    int     batch_frame[n_batch_max];
+    float * batch_out[n_batch_max];
+    int     n_batch = 0;
 
     // make sure n_fft == 1 + (WHISPER_N_FFT / 2), bin_0 to bin_nyquist
-    assert(n_fft == 1 + (frame_size / 2));
+    assert(filters.n_fft == 1 + (frame_size / 2));
+    assert(filters.band_start.size() == (size_t) mel.n_mel);
+    assert(plan.n == frame_size);
 
-    // calculate FFT only when fft_in are not all zero
-    for (; i < std::min(n_samples / frame_step + 1, mel.n_len); i += n_threads) {
-        const int offset = i * frame_step;
+    auto store = [&](int i, const float * out) {
+        for (int j = 0; j < mel.n_mel; j++) {
+            mel.data[j * mel.n_len + i] = out[j];
+        }
+    };
 
-        // apply Hann window (~10% faster)
-        for (int j = 0; j < std::min(frame_size, n_samples - offset); j++) {
-            fft_in[j] = hann[j] * samples[offset + j];
+    // a full batch goes through the FFT at once, the last few frames one by one
+    auto flush = [&]() {
+        if (n_batch == n_batch_max) {
+            whisper_rfft<n_batch_max>(plan, fft_in.data(), frame_size, fft_out.data(), n_spectrum, fft_work.data());
+            log_mel_power(fft_out.data(), n_spectrum, n_batch_max, filters.n_fft, power.data());
+            log_mel_bands<n_batch_max>(power.data(), filters, mel.n_mel, batch_out);
+        } else {
+            for (int b = 0; b < n_batch; b++) {
+                whisper_rfft<1>(plan, fft_in.data() + b * frame_size, frame_size, fft_out.data(), n_spectrum, fft_work.data());
+                log_mel_power(fft_out.data(), n_spectrum, 1, filters.n_fft, power.data());
+                log_mel_bands<1>(power.data(), filters, mel.n_mel, batch_out + b);
+            }
         }
 
-        // fill the rest with zeros
-        if (n_samples - offset < frame_size) {
-            std::fill(fft_in.begin() + (n_samples - offset), fft_in.end(), 0.0);
+        for (int b = 0; b < n_batch; b++) {
+            store(batch_frame[b], batch_out[b]);
         }
 
-        // FFT
-        fft(fft_in.data(), frame_size, fft_out.data());
+        n_batch = 0;
+    };
 
-        // Calculate modulus^2 of complex numbers
-        // Use pow(fft_out[2 * j + 0], 2) + pow(fft_out[2 * j + 1], 2) causes inference quality problem? Interesting.
-        for (int j = 0; j < n_fft; j++) {
-            fft_out[j] = (fft_out[2 * j + 0] * fft_out[2 * j + 0] + fft_out[2 * j + 1] * fft_out[2 * j + 1]);
+    // each thread takes a contiguous range of frames, so that it reads one stretch of samples
+    // and writes one stretch of every mel row; the frames that need an FFT and the all-zero ones
+    // past the end of the audio are split separately to keep the threads balanced
+    const int n_fft_frames = std::min(n_samples / frame_step + 1, mel.n_len);
+    auto range = [&](int begin, int end, int & i0, int & i1) {
+        const int n_per_thread = (end - begin + n_threads - 1) / n_threads;
+        i0 = std::min(end, begin + ith * n_per_thread);
+        i1 = std::min(end, i0 + n_per_thread);
+    };
+
+    int i0, i1;
+    range(0, n_fft_frames, i0, i1);
+
+    // calculate FFT only when fft_in are not all zero
+    for (int i = i0; i < i1; i++) {
+        const int offset = i * frame_step;
+
+        // frames that see neither the reflective padding nor the zero padding are the same in
+        // every window that contains them, those go through the stream cache
+        float * out = columns.data() + n_batch * mel.n_mel;
+        if (stream && offset >= frame_size/2 && offset + frame_size <= n_samples) {
+            const int64_t center = stream_pos + offset;
+            const size_t  slot   = (center / frame_step) % whisper_mel_stream::n_slots;
+
+            out = stream->data.data() + slot*mel.n_mel;
+            if (stream->center[slot] == center) {
+                store(i, out);
+                continue;
+            }
+            stream->center[slot] = center;
         }
 
-        // mel spectrogram
-        for (int j = 0; j < mel.n_mel; j++) {
-            double sum = 0.0;
-            // unroll loop (suggested by GH user @lunixbochs)
-            int k = 0;
-            for (k = 0; k < n_fft - 3; k += 4) {
-                sum +=
-                        fft_out[k + 0] * filters.data[j * n_fft + k + 0] +
-                        fft_out[k + 1] * filters.data[j * n_fft + k + 1] +
-                        fft_out[k + 2] * filters.data[j * n_fft + k + 2] +
-                        fft_out[k + 3] * filters.data[j * n_fft + k + 3];
-            }
-            // handle n_fft remainder
-            for (; k < n_fft; k++) {
-                sum += fft_out[k] * filters.data[j * n_fft + k];
-            }
-            sum = log10(std::max(sum, 1e-10));
-            mel.data[j * mel.n_len + i] = sum;
+        log_mel_window(hann, samples.data() + offset, n_samples - offset, frame_size, fft_in.data() + n_batch * frame_size);
+        batch_frame[n_batch] = i;
+        batch_out[n_batch]   = out;
+
+        if (++n_batch == n_batch_max) {
+            flush();
         }
     }
 
+    flush();
+
+    range(n_fft_frames, mel.n_len, i0, i1);
+
     // Otherwise fft_out are all zero
     double sum = log10(1e-10);
-    for (; i < mel.n_len; i += n_threads) {
+    for (int i = i0; i < i1; i++) {
         for (int j = 0; j < mel.n_mel; j++) {
             mel.data[j * mel.n_len + i] = sum;
         }
@@ -3178,7 +3519,8 @@ static bool log_mel_spectrogram(
               const int   n_threads,
               const whisper_filters & filters,
               const bool   debug,
-              whisper_mel & mel) {
+              whisper_mel & mel,
+              const int64_t stream_pos = -1) {
     const int64_t t_start_us = ggml_time_us();
 
     // Hann window
@@ -3186,7 +3528,12 @@ static bool log_mel_spectrogram(
     const float * hann = global_cache.hann_window;
 
     // Calculate the length of padding
+    // with a reduced audio_ctx the encoder never reads more than 2*audio_ctx frames past
+    // the end of the audio, so there is no point in computing 30 seconds of silence
     int64_t stage_1_pad = WHISPER_SAMPLE_RATE * 30;
+    if (wstate.exp_n_audio_ctx > 0) {
+        stage_1_pad = std::min<int64_t>(stage_1_pad, 2*wstate.exp_n_audio_ctx*frame_step);
+    }
     int64_t stage_2_pad = frame_size / 2;
 
     // Initialize a vector and copy data from C array to it.
@@ -3194,13 +3541,14 @@ static bool log_mel_spectrogram(
     samples_padded.resize(n_samples + stage_1_pad + stage_2_pad * 2);
     std::copy(samples, samples + n_samples, samples_padded.begin() + stage_2_pad);
 
-    // pad 30 seconds of zeros at the end of audio (480,000 samples) + reflective pad 200 samples at the end of audio
+    // pad stage_1_pad zeros at the end of audio (30 s = 480,000 samples) + reflective pad 200 samples at the end of audio
     std::fill(samples_padded.begin() + n_samples + stage_2_pad, samples_padded.begin() + n_samples + stage_1_pad + 2 * stage_2_pad, 0);
 
     // reflective pad 200 samples at the beginning of audio
     std::reverse_copy(samples + 1, samples + 1 + stage_2_pad, samples_padded.begin());
 
     mel.n_mel     = n_mel;
+    mel.stream_pos = stream_pos;
     // https://github.com/pytorch/pytorch/blob/main/aten/src/ATen/native/SpectralOps.cpp#L936
     // Calculate number of frames + remove the last frame
     mel.n_len     = (samples_padded.size() - frame_size) / frame_step;
@@ -3208,23 +3556,19 @@ static bool log_mel_spectrogram(
     mel.n_len_org = 1 + (n_samples + stage_2_pad - frame_size) / frame_step;
     mel.data.resize(mel.n_mel * mel.n_len);
 
-    {
-        std::vector<std::thread> workers(n_threads - 1);
-        for (int iw = 0; iw < n_threads - 1; ++iw) {
-            workers[iw] = std::thread(
-                    log_mel_spectrogram_worker_thread, iw + 1, hann, std::cref(samples_padded),
-                    n_samples + stage_2_pad, frame_size, frame_step, n_threads,
-                    std::cref(filters), std::ref(mel));
-        }
-
-        // main thread
-        log_mel_spectrogram_worker_thread(0, hann, samples_padded, n_samples + stage_2_pad, frame_size, frame_step, n_threads, filters, mel);
-
-        for (int iw = 0; iw < n_threads - 1; ++iw) {
-            workers[iw].join();
+    // the slots of one window must not collide, longer audio is not cached
+    whisper_mel_stream * stream = nullptr;
+    if (stream_pos >= 0 && (n_samples + stage_2_pad)/frame_step + 1 <= whisper_mel_stream::n_slots) {
+        stream = &wstate.mel_stream;
+        if (stream->n_mel != n_mel) {
+            stream->reset(n_mel);
         }
     }
 
+    wstate.mel_pool.run(n_threads, [&](int ith) {
+        log_mel_spectrogram_worker_thread(ith, hann, samples_padded, n_samples + stage_2_pad, frame_size, frame_step, n_threads, filters, mel, stream, stream_pos);
+    });
+
     // clamping and normalization
     double mmax = -1e20;
     for (int i = 0; i < mel.n_mel*mel.n_len; i++) {
@@ -3873,7 +4217,11 @@ void whisper_free_params(struct whisper_full_params * params) {
 }
 
 int whisper_pcm_to_mel_with_state(struct whisper_context * ctx, struct whisper_state * state, const float * samples, int n_samples, int n_threads) {
-    if (!log_mel_spectrogram(*state, samples, n_samples, WHISPER_SAMPLE_RATE, WHISPER_N_FFT, WHISPER_HOP_LENGTH, ctx->model.filters.n_mel, n_threads, ctx->model.filters, false, state->mel)) {
+    return whisper_pcm_to_mel_stream_with_state(ctx, state, samples, n_samples, -1, n_threads);
+}
+
+int whisper_pcm_to_mel_stream_with_state(struct whisper_context * ctx, struct whisper_state * state, const float * samples, int n_samples, int64_t stream_pos, int n_threads) {
+    if (!log_mel_spectrogram(*state, samples, n_samples, WHISPER_SAMPLE_RATE, WHISPER_N_FFT, WHISPER_HOP_LENGTH, ctx->model.filters.n_mel, n_threads, ctx->model.filters, false, state->mel, stream_pos)) {
         WHISPER_LOG_ERROR("%s: failed to compute mel spectrogram\n", __func__);
         return -1;
     }
@@ -3881,6 +4229,17 @@ int whisper_pcm_to_mel_with_state(struct whisper_context * ctx, struct whisper_s
     return 0;
 }
 
+void whisper_mel_stream_reset(struct whisper_context * ctx) {
+    whisper_mel_stream_reset_with_state(ctx->state);
+}
+
+void whisper_mel_stream_reset_with_state(struct whisper_state * state) {
+    state->mel_stream.n_mel = 0;
+    state->mel_stream.center.clear();
+    state->mel_stream.data.clear();
+    state->conv_cache.reset();
+}
+
 int whisper_pcm_to_mel(struct whisper_context * ctx, const float * samples, int n_samples, int n_threads) {
     return whisper_pcm_to_mel_with_state(ctx, ctx->state, samples, n_samples, n_threads);
 }
@@ -3899,6 +4258,7 @@ int whisper_set_mel_with_state(
     state->mel.n_len     = n_len;
     state->mel.n_len_org = n_len;
     state->mel.n_mel     = n_mel;
+    state->mel.stream_pos = -1;
 
     state->mel.data.resize(n_len*n_mel);
     memcpy(state->mel.data.data(), data, n_len*n_mel*sizeof(float));
@@ -4424,6 +4784,22 @@ struct whisper_vad_context {
     struct ggml_tensor * h_state;
     struct ggml_tensor * c_state;
     std::vector<float>   probs;
+
+    // streaming state, see whisper_vad_stream_push()
+    struct {
+        whisper_vad_params params;
+
+        std::vector<float> tail;     // samples that do not fill a whole window yet
+        int64_t            n_frames = 0; // windows processed since the last reset
+
+        bool    in_speech    = false;
+        int64_t speech_start = -1; // candidate start, waiting for min_speech_duration_ms
+        int64_t speech_end   = -1; // candidate end, waiting for min_silence_duration_ms
+
+        // results of the last push
+        std::vector<float>             probs;
+        std::vector<whisper_vad_event> events;
+    } stream;
 };
 
 struct whisper_vad_context_params whisper_vad_default_context_params(void) {
@@ -4711,6 +5087,9 @@ static bool whisper_vad_init_context(whisper_vad_context * vctx) {
         WHISPER_LOG_INFO("%s: compute buffer (VAD)   = %7.2f MB\n", __func__, whisper_sched_size(vctx->sched) / 1e6);
     }
 
+    vctx->stream.params = whisper_vad_default_params();
+    vctx->stream.tail.reserve(vctx->n_window);
+
     return true;
 }
 
@@ -5165,6 +5544,172 @@ bool whisper_vad_detect_speech(
     return true;
 }
 
+void whisper_vad_stream_reset(struct whisper_vad_context * vctx, struct whisper_vad_params params) {
+    auto & st = vctx->stream;
+
+    // Reset LSTM hidden/cell states
+    ggml_backend_buffer_clear(vctx->buffer, 0);
+
+    st.params       = params;
+    st.n_frames     = 0;
+    st.in_speech    = false;
+    st.speech_start = -1;
+    st.speech_end   = -1;
+
+    st.tail.clear();
+    st.probs.clear();
+    st.events.clear();
+}
+
+// hysteresis over the per-window probabilities, same thresholds as whisper_vad_segments_from_probs()
+static void whisper_vad_stream_update(whisper_vad_context & vctx, float prob) {
+    auto & st = vctx.stream;
+
+    const float threshold     = st.params.threshold;
+    const float neg_threshold = std::max(threshold - 0.15f, 0.01f);
+
+    const int64_t min_speech_samples  = (int64_t) WHISPER_SAMPLE_RATE * st.params.min_speech_duration_ms  / 1000;
+    const int64_t min_silence_samples = (int64_t) WHISPER_SAMPLE_RATE * st.params.min_silence_duration_ms / 1000;
+    const int64_t speech_pad_samples  = (int64_t) WHISPER_SAMPLE_RATE * st.params.speech_pad_ms           / 1000;
+
+    const int64_t t_begin = st.n_frames * vctx.n_window;
+    const int64_t t_end   = t_begin + vctx.n_window;
+
+    if (!st.in_speech) {
+        if (prob >= threshold) {
+            if (st.speech_start < 0) {
+                st.speech_start = t_begin;
+            }
+
+            if (t_end - st.speech_start >= min_speech_samples) {
+                st.in_speech  = true;
+                st.speech_end = -1;
+                st.events.push_back({ WHISPER_VAD_EVENT_SPEECH_START, std::max<int64_t>(0, st.speech_start - speech_pad_samples) });
+            }
+        } else if (prob < neg_threshold) {
+            // shorter than min_speech_duration_ms
+            st.speech_start = -1;
+        }
+
+        return;
+    }
+
+    if (prob >= threshold) {
+        st.speech_end = -1;
+        return;
+    }
+
+    if (prob < neg_threshold) {
+        if (st.speech_end < 0) {
+            st.speech_end = t_begin;
+        }
+
+        if (t_end - st.speech_end >= min_silence_samples) {
+            st.events.push_back({ WHISPER_VAD_EVENT_SPEECH_END, std::min(t_end, st.speech_end + speech_pad_samples) });
+
+            st.in_speech    = false;
+            st.speech_start = -1;
+            st.speech_end   = -1;
+        }
+    }
+}
+
+int whisper_vad_stream_push(
+        struct whisper_vad_context * vctx,
+        const float * samples,
+        int n_samples) {
+    auto & st = vctx->stream;
+
+    st.probs.clear();
+    st.events.clear();
+
+    const int n_window = vctx->n_window;
+    const int n_tail   = (int) st.tail.size();
+    const int n_frames = (n_tail + n_samples) / n_window;
+
+    if (n_frames == 0) {
+        st.tail.insert(st.tail.end(), samples, samples + n_samples);
+        return 0;
+    }
+
+    auto & sched = vctx->sched.sched;
+
+    ggml_cgraph * gf = whisper_vad_build_graph(*vctx);
+
+    if (!ggml_backend_sched_alloc_graph(sched, gf)) {
+        WHISPER_LOG_ERROR("%s: failed to allocate the compute buffer\n", __func__);
+        return -1;
+    }
+
+    struct ggml_tensor * frame = ggml_graph_get_tensor(gf, "frame");
+    struct ggml_tensor * prob  = ggml_graph_get_tensor(gf, "prob");
+
+    const int64_t t_start_vad_us = ggml_time_us();
+
+    int i_sample = 0;
+
+    for (int i = 0; i < n_frames; i++) {
+        if (!st.tail.empty()) {
+            // complete the window left over from the previous push
+            const int n_fill = n_window - (int) st.tail.size();
+            st.tail.insert(st.tail.end(), samples, samples + n_fill);
+            i_sample += n_fill;
+
+            ggml_backend_tensor_set(frame, st.tail.data(), 0, n_window * sizeof(float));
+            st.tail.clear();
+        } else {
+            ggml_backend_tensor_set(frame, samples + i_sample, 0, n_window * sizeof(float));
+            i_sample += n_window;
+        }
+
+        // do not reset the scheduler - we will reuse the graph in the next window
+        if (!ggml_graph_compute_helper(sched, gf, vctx->n_threads, false)) {
+            WHISPER_LOG_ERROR("%s: failed to compute VAD graph\n", __func__);
+            ggml_backend_sched_reset(sched);
+            return -1;
+        }
+
+        float p = 0.0f;
+        ggml_backend_tensor_get(prob, &p, 0, sizeof(float));
+
+        st.probs.push_back(p);
+        whisper_vad_stream_update(*vctx, p);
+        st.n_frames++;
+    }
+
+    st.tail.assign(samples + i_sample, samples + n_samples);
+
+    vctx->t_vad_us += ggml_time_us() - t_start_vad_us;
+
+    ggml_backend_sched_reset(sched);
+
+    return n_frames;
+}
+
+int whisper_vad_stream_n_probs(struct whisper_vad_context * vctx) {
+    return vctx->stream.probs.size();
+}
+
+const float * whisper_vad_stream_probs(struct whisper_vad_context * vctx) {
+    return vctx->stream.probs.data();
+}
+
+int whisper_vad_stream_n_events(struct whisper_vad_context * vctx) {
+    return vctx->stream.events.size();
+}
+
+struct whisper_vad_event whisper_vad_stream_get_event(struct whisper_vad_context * vctx, int i_event) {
+    return vctx->stream.events[i_event];
+}
+
+bool whisper_vad_stream_in_speech(struct whisper_vad_context * vctx) {
+    return vctx->stream.in_speech;
+}
+
+int whisper_vad_n_window(struct whisper_vad_context * vctx) {
+    return vctx->n_window;
+}
+
 int whisper_vad_segments_n_segments(struct whisper_vad_segments * segments) {
     return segments->data.size();
 }
@@ -5930,6 +6475,9 @@ struct whisper_full_params whisper_full_default_params(enum whisper_sampling_str
 
         /*.debug_mode        =*/ false,
         /*.audio_ctx         =*/ 0,
+        /*.stream_pos        =*/ -1,
+        /*.conv_cache        =*/ false,
+        /*.conv_cache_resync =*/ 8,
 
         /*.tdrz_enable       =*/ false,
 
@@ -6800,9 +7348,20 @@ int whisper_full_with_state(
 
     result_all.clear();
 
+    // overwrite audio_ctx, max allowed is hparams.n_audio_ctx
+    // set before computing the mel, its padding depends on it
+    if (params.audio_ctx > whisper_n_audio_ctx(ctx)) {
+        WHISPER_LOG_ERROR("%s: audio_ctx is larger than the maximum allowed (%d > %d)\n", __func__, params.audio_ctx, whisper_n_audio_ctx(ctx));
+        return -5;
+    }
+    state->exp_n_audio_ctx = params.audio_ctx;
+
+    state->exp_conv_cache        = params.conv_cache && params.stream_pos >= 0;
+    state->exp_conv_cache_resync = params.conv_cache_resync;
+
     if (n_samples > 0) {
         // compute log mel spectrogram
-        if (whisper_pcm_to_mel_with_state(ctx, state, samples, n_samples, params.n_threads) != 0) {
+        if (whisper_pcm_to_mel_stream_with_state(ctx, state, samples, n_samples, params.stream_pos, params.n_threads) != 0) {
             WHISPER_LOG_ERROR("%s: failed to compute log mel spectrogram\n", __func__);
             return -2;
         }
@@ -6943,13 +7502,6 @@ int whisper_full_with_state(
         }
     }
 
-    // overwrite audio_ctx, max allowed is hparams.n_audio_ctx
-    if (params.audio_ctx > whisper_n_audio_ctx(ctx)) {
-        WHISPER_LOG_ERROR("%s: audio_ctx is larger than the maximum allowed (%d > %d)\n", __func__, params.audio_ctx, whisper_n_audio_ctx(ctx));
-        return -5;
-    }
-    state->exp_n_audio_ctx = params.audio_ctx;
-
     // these tokens determine the task that will be performed
     std::vector<whisper_token> prompt_init = { whisper_token_sot(ctx), };
 
@@ -7809,6 +8361,7 @@ int whisper_full_parallel(
         auto params_cur = params;
 
         params_cur.offset_ms = 0;
+        params_cur.stream_pos = params.stream_pos >= 0 ? params.stream_pos + start_samples : -1;
         params_cur.print_progress = false;
         params_cur.print_realtime = false;
 
@@ -6,7 +6,10 @@
 #include <atomic>
 #include <cctype>
 #include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <mutex>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <vector>
@@ -25,9 +28,12 @@ struct whisper_params {
   int32_t capture_id;
   int32_t max_tokens;
   int32_t audio_ctx;
+  // size audio_ctx to each decoded window instead of a fixed audio_ctx
+  bool auto_audio_ctx;
   int32_t beam_size;
   int32_t max_context_tokens;
   int32_t max_retry_attempts;
+  int32_t wait_timeout_ms;
   bool translate;
   bool no_fallback;
   bool print_special;
@@ -39,6 +45,23 @@ struct whisper_params {
 
   std::string language;
   std::string model;
+
+  // Silero VAD gate; falls back to the energy gate if the model is missing
+  bool use_vad;
+  std::string vad_model;
+
+  // Decode once per utterance instead of every step (requires the VAD).
+  // hangover_ms is the silence that ends an utterance; partial_ms > 0 decodes
+  // one partial hypothesis once an utterance is that long.
+  bool segment_utterances;
+  int32_t hangover_ms;
+  int32_t max_utterance_ms;
+  int32_t partial_ms;
+
+  // [experimental] reuse the encoder conv stem output of the audio that
+  // overlapping windows share; a full pass every conv_cache_resync encodes
+  bool conv_cache;
+  int32_t conv_cache_resync;
 };
 
 class WhisperContext {
@@ -75,9 +98,11 @@ whisper_params get_default_params() {
   params.capture_id = -1;
   params.max_tokens = 32;
   params.audio_ctx = 0;
+  params.auto_audio_ctx = true;
   params.beam_size = -1;
   params.max_context_tokens = 64;
   params.max_retry_attempts = 2;
+  params.wait_timeout_ms = 2000;
   params.translate = false;
   params.no_fallback = false;
   params.print_special = false;
@@ -88,6 +113,14 @@ whisper_params get_default_params() {
   params.flash_attn = true;
   params.language = "en";
   params.model = STT_MODEL_DIR "/ggml-tiny.en.bin";
+  params.use_vad = true;
+  params.vad_model = STT_MODEL_DIR "/ggml-silero-v5.1.2.bin";
+  params.segment_utterances = true;
+  params.hangover_ms = 500;
+  params.max_utterance_ms = 10000;
+  params.partial_ms = 0;
+  params.conv_cache = false;
+  params.conv_cache_resync = 8;
   return params;
 }
 
@@ -107,16 +140,35 @@ bool simple_vad(const std::vector<float> &audio) {
     energy += sample * sample;
   }
   energy /= audio.size();
-  printf("Audio energy: %.6f\n", energy);
   return energy > 0.005f;
 }
 
+std::chrono::steady_clock::duration samples_to_duration(int64_t n_samples) {
+  return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::microseconds(n_samples * 1000000 / WHISPER_SAMPLE_RATE));
+}
+
+// The encoder sees one frame per 320 samples (10 ms hop, stride 2 conv).
+// Whisper is trained on windows padded with silence, so some trailing context
+// is kept, and sizes are rounded up to buckets so only a handful of encoder
+// graph shapes occur; all of them fit in the compute buffers whisper reserves
+// for the full 1500-frame context, so switching sizes never re-reserves them.
+const int AUDIO_CTX_MARGIN = 64;
+const int AUDIO_CTX_BUCKET = 64;
+
+int audio_ctx_for_samples(int n_samples, int n_audio_ctx_max) {
+  const int n_frames = (n_samples + 319) / 320 + AUDIO_CTX_MARGIN;
+  const int n_bucket =
+      (n_frames + AUDIO_CTX_BUCKET - 1) / AUDIO_CTX_BUCKET * AUDIO_CTX_BUCKET;
+  return std::min(n_bucket, n_audio_ctx_max);
+}
+
 bool process_audio_with_retry(whisper_context *ctx,
                               const whisper_full_params &wparams,
-                              const std::vector<float> &pcmf32,
+                              const float *samples, int n_samples,
                               int max_attempts) {
   for (int attempt = 0; attempt < max_attempts; ++attempt) {
-    int result = whisper_full(ctx, wparams, pcmf32.data(), pcmf32.size());
+    int result = whisper_full(ctx, wparams, samples, n_samples);
 
     if (result == 0) {
       return true;
@@ -147,22 +199,88 @@ struct STTStream::Impl {
   WhisperContext *ctx = nullptr;
   audio_async *audio = nullptr;
 
+  whisper_vad_context *vad = nullptr;
+  whisper_vad_params vad_params;
+  // samples fed to the streaming VAD since its last reset
+  int64_t vad_pos = 0;
+
+  // utterance mode
+  std::vector<float> utterance;
+  // capture position of utterance[0]
+  uint64_t utterance_pos = 0;
+  bool in_utterance = false;
+  bool partial_done = false;
+
   std::vector<float> pcmf32;
-  std::vector<float> pcmf32_old;
-  std::vector<float> pcmf32_new;
   std::vector<whisper_token> prompt_tokens;
+  // samples before read_pos that the next window keeps from the previous one
+  int n_samples_history = 0;
+
+  // built once, only the prompt is updated per decode
+  whisper_full_params wparams;
+  whisper_full_params wparams_partial;
+
+  // capture position up to which audio has been consumed
+  uint64_t read_pos = 0;
+  // offset in pcmf32 where the samples of the current step begin
+  int step_begin = 0;
+  // capture position of pcmf32[0]. Capture positions never repeat, so they
+  // key whisper's mel column cache across overlapping windows
+  uint64_t window_pos = 0;
 
   std::atomic<bool> initialized{false};
   std::atomic<bool> paused{false};
+  std::atomic<bool> quit{false};
+
+  // bumped by pause()/resume(); the transcribing thread drops its buffers and
+  // read cursor when it sees a new value, so they are never touched from two
+  // threads
+  std::atomic<uint32_t> generation{0};
+  uint32_t seen_generation = 0;
 
   int n_samples_step;
   int n_samples_len;
   int n_samples_keep;
   int n_samples_30s;
+  int n_samples_utterance;
+  int n_samples_partial;
   int n_new_line;
   int n_iter = 0;
 
+  // asynchronous mode
+  std::thread worker;
+  std::atomic<bool> worker_running{false};
+  std::mutex state_mutex;
+  std::condition_variable state_cv;
+
+  std::mutex queue_mutex;
+  std::condition_variable queue_cv;
+  // fixed ring of result slots; results are swapped in and out so the text
+  // buffers circulate between the worker, the slots and the caller instead
+  // of being reallocated
+  std::vector<STTResult> queue;
+  size_t queue_head = 0;
+  size_t queue_size = 0;
+  std::function<void(const STTResult &)> callback;
+
+  bool capture_step(bool poll_events);
+  bool detect_speech(int &begin, int &end);
+  void reset_vad();
+  int align_to_hop(int offset) const;
+  void init_wparams();
+  bool decode(const float *samples, int n_samples, uint64_t pos, bool partial,
+              STTResult &result);
+  void update_prompt();
+  bool transcribe(STTResult &result);
+  bool transcribe_utterance(STTResult &result);
+  void publish(STTResult &result);
+  void pop_front(STTResult &result);
+  void worker_loop();
+
   ~Impl() {
+    if (vad) {
+      whisper_vad_free(vad);
+    }
     if (audio) {
       delete audio;
     }
@@ -184,8 +302,8 @@ void STTStream::debug_state() const {
     total_tokens += whisper_full_n_tokens(impl->ctx->get(), i);
   }
 
-  fprintf(stderr, "DEBUG: n_iter=%d, pcmf32_old.size=%zu\n", impl->n_iter,
-          impl->pcmf32_old.size());
+  fprintf(stderr, "DEBUG: n_iter=%d, n_samples_history=%d\n", impl->n_iter,
+          impl->n_samples_history);
   fprintf(stderr, "  segments=%d, tokens=%d, prompt_tokens=%zu\n", n_segments,
           total_tokens, impl->prompt_tokens.size());
 }
@@ -211,6 +329,13 @@ STTStream::STTStream() : impl(new Impl()) {
   impl->n_samples_keep = (1e-3 * impl->params.keep_ms) * WHISPER_SAMPLE_RATE;
   impl->n_samples_30s = (1e-3 * 30000.0) * WHISPER_SAMPLE_RATE;
 
+  // one step of speech can be appended after the limit is reached, and
+  // whisper only looks at 30 s
+  impl->n_samples_utterance =
+      std::min((int)((1e-3 * impl->params.max_utterance_ms) * WHISPER_SAMPLE_RATE),
+               impl->n_samples_30s - impl->n_samples_len - 2 * impl->n_samples_step);
+  impl->n_samples_partial = (1e-3 * impl->params.partial_ms) * WHISPER_SAMPLE_RATE;
+
   impl->n_new_line =
       std::max(1, impl->params.length_ms / impl->params.step_ms - 1);
 
@@ -235,8 +360,25 @@ STTStream::STTStream() : impl(new Impl()) {
 
     impl->ctx = new WhisperContext(impl->params.model.c_str(), cparams);
 
-    impl->pcmf32.resize(impl->n_samples_30s, 0.0f);
-    impl->pcmf32_new.resize(impl->n_samples_30s, 0.0f);
+    impl->vad_params = whisper_vad_default_params();
+    if (impl->params.use_vad) {
+      whisper_vad_context_params vparams = whisper_vad_default_context_params();
+      vparams.n_threads = impl->params.n_threads;
+
+      impl->vad = whisper_vad_init_from_file_with_params(
+          impl->params.vad_model.c_str(), vparams);
+      if (!impl->vad) {
+        fprintf(stderr,
+                "WARNING: Failed to load VAD model %s, using energy gate\n",
+                impl->params.vad_model.c_str());
+      }
+    }
+
+    impl->pcmf32.reserve(impl->n_samples_30s);
+    impl->utterance.reserve(impl->n_samples_30s);
+    // decoded tokens never exceed the text context
+    impl->prompt_tokens.reserve(whisper_n_text_ctx(impl->ctx->get()));
+    impl->reset_vad();
 
     if (!whisper_is_multilingual(impl->ctx->get())) {
       if (impl->params.language != "en" || impl->params.translate) {
@@ -245,6 +387,8 @@ STTStream::STTStream() : impl(new Impl()) {
       }
     }
 
+    impl->init_wparams();
+
     impl->initialized = true;
     impl->paused = false;
 
@@ -266,14 +410,13 @@ STTStream::STTStream() : impl(new Impl()) {
     }
 
     impl->pcmf32.clear();
-    impl->pcmf32_new.clear();
-    impl->pcmf32_old.clear();
     impl->prompt_tokens.clear();
   }
 }
 
 STTStream::~STTStream() {
   if (impl) {
+    stop_async();
     impl->initialized = false;
     delete impl;
   }
@@ -282,112 +425,241 @@ STTStream::~STTStream() {
 // for custom app manager
 bool STTStream::is_initialized() const { return impl && impl->initialized; }
 
-std::string STTStream::start_listening() {
-  if (!impl->initialized) {
-    fprintf(stderr, "ERROR: Stream not initialized\n");
-    return "";
-  }
-
-  if (impl->paused) {
-    return "";
-  }
-
-  bool got_quit = !sdl_poll_events();
-  if (got_quit) {
-    return "";
+// Blocks until a full step of new audio is available and assembles the
+// decode window in pcmf32. Returns false when paused, stopped or on SDL quit.
+bool STTStream::Impl::capture_step(bool poll_events) {
+  const uint32_t gen = generation.load();
+  if (gen != seen_generation) {
+    seen_generation = gen;
+    pcmf32.clear();
+    n_samples_history = 0;
+    read_pos = audio->position();
+    reset_vad();
   }
 
   while (true) {
-    if (!sdl_poll_events()) {
-      return "";
+    if (poll_events && !sdl_poll_events()) {
+      quit = true;
+      return false;
+    }
+
+    if (paused || generation.load() != seen_generation) {
+      return false;
     }
 
-    if (impl->paused) {
-      return "";
+    if (!poll_events && !worker_running) {
+      return false;
     }
 
-    impl->audio->get(impl->params.step_ms, impl->pcmf32_new);
+    const uint64_t n_available = audio->position() - read_pos;
 
-    if ((int)impl->pcmf32_new.size() > 2 * impl->n_samples_step) {
-      impl->audio->clear();
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
-      continue;
+    // fell behind real time (e.g. a slow decode), drop the backlog and
+    // continue from the most recent step
+    if (n_available > 2 * (uint64_t)n_samples_step) {
+      read_pos = audio->position() - n_samples_step;
+      reset_vad();
+      break;
     }
 
-    if ((int)impl->pcmf32_new.size() >= impl->n_samples_step) {
-      impl->audio->clear();
+    if (n_available >= (uint64_t)n_samples_step) {
       break;
     }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    // sleep until the capture callback reports a full step; the timeout only
+    // bounds how long SDL events and pause() can go unnoticed
+    audio->wait_for(read_pos, n_samples_step, params.wait_timeout_ms);
   }
 
-  const int n_samples_new = impl->pcmf32_new.size();
+  // the kept audio of the previous steps is still in the capture ring (it
+  // holds twice length_ms), so the whole window is copied out of it in one go
+  const int n_samples_new = audio->position() - read_pos;
   const int n_samples_take = std::min(
-      (int)impl->pcmf32_old.size(),
-      std::max(0, impl->n_samples_keep + impl->n_samples_len - n_samples_new));
+      n_samples_history,
+      std::max(0, n_samples_keep + n_samples_len - n_samples_new));
+
+  const audio_view view = audio->view_since(read_pos - n_samples_take,
+                                            n_samples_take + n_samples_new);
+
+  // pcmf32 has n_samples_30s reserved, this never reallocates
+  pcmf32.resize(view.size());
+  view.copy_to(pcmf32.data());
 
-  impl->pcmf32.resize(n_samples_new + n_samples_take);
+  step_begin = view.pos < read_pos ? (int)(read_pos - view.pos) : 0;
+  window_pos = view.pos;
+  read_pos = view.end();
 
-  for (int i = 0; i < n_samples_take; i++) {
-    impl->pcmf32[i] =
-        impl->pcmf32_old[impl->pcmf32_old.size() - n_samples_take + i];
+  if (!audio->is_valid(view)) {
+    // overwritten while copying, only possible far behind real time
+    n_samples_history = 0;
+    return false;
   }
 
-  memcpy(impl->pcmf32.data() + n_samples_take, impl->pcmf32_new.data(),
-         n_samples_new * sizeof(float));
-  impl->pcmf32_old = impl->pcmf32;
+  n_samples_history = pcmf32.size();
 
-  if (!simple_vad(impl->pcmf32)) {
-    return "";
+  return true;
+}
+
+// Runs the VAD over the samples of the current step only and narrows the
+// decode range [begin, end) of pcmf32 to the detected speech. Returns false
+// when there is nothing worth running the encoder on.
+bool STTStream::Impl::detect_speech(int &begin, int &end) {
+  begin = 0;
+  end = pcmf32.size();
+
+  if (!vad) {
+    begin = align_to_hop(0);
+    return simple_vad(pcmf32);
   }
 
-  whisper_full_params wparams = whisper_full_default_params(
-      impl->params.beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH
-                                 : WHISPER_SAMPLING_GREEDY);
-
-  wparams.print_progress = false;
-  wparams.print_special = impl->params.print_special;
-  wparams.print_realtime = false;
-  wparams.print_timestamps = !impl->params.no_timestamps;
-  wparams.translate = impl->params.translate;
-  wparams.max_tokens = impl->params.max_tokens;
-  wparams.single_segment = true;
-  wparams.language = impl->params.language.c_str();
-  wparams.n_threads = impl->params.n_threads;
-  wparams.beam_search.beam_size = impl->params.beam_size;
-  wparams.audio_ctx = impl->params.audio_ctx;
-  wparams.tdrz_enable = impl->params.tinydiarize;
-  wparams.temperature_inc =
-      impl->params.no_fallback ? 0.0f : wparams.temperature_inc;
-  wparams.prompt_tokens =
-      impl->params.no_context ? nullptr : impl->prompt_tokens.data();
-  wparams.prompt_n_tokens =
-      impl->params.no_context ? 0 : impl->prompt_tokens.size();
-
-  if (!process_audio_with_retry(impl->ctx->get(), wparams, impl->pcmf32,
-                                impl->params.max_retry_attempts)) {
-    return "";
+  const int n_step = end - step_begin;
+  const int64_t step_pos = vad_pos;
+  const bool had_speech = whisper_vad_stream_in_speech(vad);
+
+  // the VAD keeps its LSTM state and any partial window across steps, so
+  // only the new samples are pushed
+  if (whisper_vad_stream_push(vad, pcmf32.data() + step_begin, n_step) < 0) {
+    reset_vad();
+    return simple_vad(pcmf32);
+  }
+  vad_pos += n_step;
+
+  // event times are stream positions; map them into pcmf32
+  const auto to_offset = [&](int64_t t_sample) {
+    return (int)std::max<int64_t>(0, step_begin + (t_sample - step_pos));
+  };
+
+  bool found_start = false;
+  bool found_end = false;
+  const int n_events = whisper_vad_stream_n_events(vad);
+  for (int i = 0; i < n_events; i++) {
+    const whisper_vad_event ev = whisper_vad_stream_get_event(vad, i);
+    if (ev.type == WHISPER_VAD_EVENT_SPEECH_START && !found_start) {
+      found_start = true;
+      // a word that started in the previous step needs the kept audio as well
+      if (!had_speech) {
+        begin = to_offset(ev.t_sample);
+      }
+    } else if (ev.type == WHISPER_VAD_EVENT_SPEECH_END) {
+      found_end = true;
+      end = std::min(end, to_offset(ev.t_sample));
+    }
+  }
+
+  if (!had_speech && !found_start) {
+    return false;
+  }
+
+  // speech continues into the next step
+  if (whisper_vad_stream_in_speech(vad) || !found_end) {
+    end = pcmf32.size();
+  }
+
+  begin = align_to_hop(begin);
+
+  return end > begin;
+}
+
+// Restarts the streaming VAD, e.g. when the captured audio is discontinuous.
+// An utterance in progress is dropped along with it.
+void STTStream::Impl::reset_vad() {
+  vad_pos = 0;
+  in_utterance = false;
+  partial_done = false;
+  utterance.clear();
+
+  if (vad) {
+    whisper_vad_params vparams = vad_params;
+    if (params.segment_utterances) {
+      vparams.min_silence_duration_ms = params.hangover_ms;
+    }
+    whisper_vad_stream_reset(vad, vparams);
+  }
+}
+
+// Builds the decode parameters once; decode() only points them at the current
+// prompt. Partial hypotheses are decoded greedily without temperature fallback
+// since they are superseded by the final result anyway.
+void STTStream::Impl::init_wparams() {
+  const auto setup = [this](whisper_sampling_strategy strategy) {
+    whisper_full_params wp = whisper_full_default_params(strategy);
+
+    wp.print_progress = false;
+    wp.print_special = params.print_special;
+    wp.print_realtime = false;
+    wp.print_timestamps = !params.no_timestamps;
+    wp.translate = params.translate;
+    wp.max_tokens = params.max_tokens;
+    wp.single_segment = true;
+    wp.language = params.language.c_str();
+    wp.n_threads = params.n_threads;
+    wp.beam_search.beam_size = params.beam_size;
+    wp.audio_ctx = params.audio_ctx;
+    wp.tdrz_enable = params.tinydiarize;
+    wp.temperature_inc = params.no_fallback ? 0.0f : wp.temperature_inc;
+    wp.conv_cache = params.conv_cache;
+    wp.conv_cache_resync = params.conv_cache_resync;
+
+    return wp;
+  };
+
+  wparams = setup(params.beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH
+                                       : WHISPER_SAMPLING_GREEDY);
+
+  wparams_partial = setup(WHISPER_SAMPLING_GREEDY);
+  wparams_partial.temperature_inc = 0.0f;
+}
+
+// Moves offset in pcmf32 forward to the next hop boundary of the capture
+// stream, so that the mel frames of overlapping windows line up and whisper
+// only transforms the audio it has not seen yet. Drops at most 10 ms, or
+// 20 ms with the conv cache, whose stem columns span two hops.
+int STTStream::Impl::align_to_hop(int offset) const {
+  const int hop = params.conv_cache ? 2 * WHISPER_HOP_LENGTH : WHISPER_HOP_LENGTH;
+  const int n_misaligned = (window_pos + offset) % hop;
+  return n_misaligned == 0 ? offset : offset + hop - n_misaligned;
+}
+
+// Runs whisper over [samples, samples + n_samples), which starts at capture
+// position pos, and fills in the text and confidence of result.
+bool STTStream::Impl::decode(const float *samples, int n_samples, uint64_t pos,
+                             bool partial, STTResult &result) {
+  whisper_full_params &wp = partial ? wparams_partial : wparams;
+  wp.stream_pos = (int64_t)pos;
+  wp.prompt_tokens = params.no_context ? nullptr : prompt_tokens.data();
+  wp.prompt_n_tokens = params.no_context ? 0 : prompt_tokens.size();
+  if (params.auto_audio_ctx && params.audio_ctx <= 0) {
+    wp.audio_ctx =
+        audio_ctx_for_samples(n_samples, whisper_n_audio_ctx(ctx->get()));
+  }
+
+  if (!process_audio_with_retry(ctx->get(), wp, samples, n_samples,
+                                params.max_retry_attempts)) {
+    return false;
   }
 
   printf("\33[2K\r");
 
-  std::string full_text;
-  const int n_segments = whisper_full_n_segments(impl->ctx->get());
+  // reuses the capacity of the caller's string
+  result.text.clear();
+  float p_sum = 0.0f;
+  int n_text_tokens = 0;
+
+  const whisper_token token_eot = whisper_token_eot(ctx->get());
+  const int n_segments = whisper_full_n_segments(ctx->get());
   for (int i = 0; i < n_segments; ++i) {
-    const char *text = whisper_full_get_segment_text(impl->ctx->get(), i);
+    const char *text = whisper_full_get_segment_text(ctx->get(), i);
 
-    if (impl->params.no_timestamps) {
+    if (params.no_timestamps) {
       printf("%s", text);
       fflush(stdout);
     } else {
-      const int64_t t0 = whisper_full_get_segment_t0(impl->ctx->get(), i);
-      const int64_t t1 = whisper_full_get_segment_t1(impl->ctx->get(), i);
+      const int64_t t0 = whisper_full_get_segment_t0(ctx->get(), i);
+      const int64_t t1 = whisper_full_get_segment_t1(ctx->get(), i);
 
       std::string output = "[" + to_timestamp(t0, false) + " --> " +
                            to_timestamp(t1, false) + "]  " + text;
 
-      if (whisper_full_get_segment_speaker_turn_next(impl->ctx->get(), i)) {
+      if (whisper_full_get_segment_speaker_turn_next(ctx->get(), i)) {
         output += " [SPEAKER_TURN]";
       }
 
@@ -397,36 +669,341 @@ std::string STTStream::start_listening() {
       fflush(stdout);
     }
 
-    full_text += text;
+    result.text += text;
+
+    // special tokens (timestamps, sot, ...) all sort after eot
+    const int n_tokens = whisper_full_n_tokens(ctx->get(), i);
+    for (int j = 0; j < n_tokens; ++j) {
+      if (whisper_full_get_token_id(ctx->get(), i, j) < token_eot) {
+        p_sum += whisper_full_get_token_p(ctx->get(), i, j);
+        n_text_tokens++;
+      }
+    }
   }
 
-  impl->n_iter++;
+  result.confidence = n_text_tokens > 0 ? p_sum / n_text_tokens : 0.0f;
+  result.partial = partial;
+
+  return true;
+}
+
+void STTStream::Impl::update_prompt() {
+  if (params.no_context) {
+    return;
+  }
 
-  if ((impl->n_iter % impl->n_new_line) == 0) {
+  prompt_tokens.clear();
+
+  const int n_segments = whisper_full_n_segments(ctx->get());
+  for (int i = 0; i < n_segments; ++i) {
+    const int token_count = whisper_full_n_tokens(ctx->get(), i);
+    for (int j = 0; j < token_count; ++j) {
+      prompt_tokens.push_back(whisper_full_get_token_id(ctx->get(), i, j));
+    }
+  }
+
+  prune_context_tokens(prompt_tokens, params.max_context_tokens);
+}
+
+// Runs whisper over the window assembled by capture_step().
+bool STTStream::Impl::transcribe(STTResult &result) {
+  if (params.segment_utterances && vad) {
+    return transcribe_utterance(result);
+  }
+
+  const auto t_audio_end = std::chrono::steady_clock::now();
+
+  int begin = 0;
+  int end = 0;
+  if (!detect_speech(begin, end)) {
+    return false;
+  }
+
+  if (!decode(pcmf32.data() + begin, end - begin, window_pos + begin, false,
+              result)) {
+    return false;
+  }
+
+  n_iter++;
+
+  if ((n_iter % n_new_line) == 0) {
     printf("\n");
-    impl->pcmf32_old = std::vector<float>(
-        impl->pcmf32.end() - impl->n_samples_keep, impl->pcmf32.end());
-
-    if (!impl->params.no_context) {
-      impl->prompt_tokens.clear();
-
-      const int n_segments = whisper_full_n_segments(impl->ctx->get());
-      for (int i = 0; i < n_segments; ++i) {
-        const int token_count = whisper_full_n_tokens(impl->ctx->get(), i);
-        for (int j = 0; j < token_count; ++j) {
-          impl->prompt_tokens.push_back(
-              whisper_full_get_token_id(impl->ctx->get(), i, j));
-        }
-      }
+    n_samples_history = std::min(n_samples_history, n_samples_keep);
+
+    update_prompt();
+  }
+
+  result.audio_end =
+      t_audio_end - samples_to_duration((int64_t)pcmf32.size() - end);
+  result.audio_start =
+      t_audio_end - samples_to_duration((int64_t)pcmf32.size() - begin);
+  result.latency_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - t_audio_end)
+                          .count();
+
+  return true;
+}
+
+// Utterance mode: collects the speech of the current step into the utterance
+// buffer and decodes it once, when the VAD reports the end of speech (after
+// the hangover) or the utterance reaches max_utterance_ms. Optionally a single
+// partial hypothesis is decoded once the utterance is partial_ms long.
+bool STTStream::Impl::transcribe_utterance(STTResult &result) {
+  const auto t_audio_end = std::chrono::steady_clock::now();
+
+  int begin = 0;
+  int end = 0;
+  if (!detect_speech(begin, end)) {
+    return false;
+  }
+
+  if (!in_utterance) {
+    in_utterance = true;
+    partial_done = false;
+    utterance.clear();
+  } else {
+    // the kept audio is already part of the utterance
+    begin = step_begin;
+    end = std::max(end, begin);
+  }
+
+  if (utterance.empty()) {
+    utterance_pos = window_pos + begin;
+  }
+  utterance.insert(utterance.end(), pcmf32.begin() + begin,
+                   pcmf32.begin() + end);
+
+  const bool ended = !whisper_vad_stream_in_speech(vad);
+  const bool full = (int)utterance.size() >= n_samples_utterance;
 
-      prune_context_tokens(impl->prompt_tokens,
-                           impl->params.max_context_tokens);
+  bool partial = false;
+  if (!ended && !full) {
+    if (params.partial_ms <= 0 || partial_done ||
+        (int)utterance.size() < n_samples_partial) {
+      return false;
     }
+    partial = true;
+    partial_done = true;
   }
 
-  return full_text;
+  const bool ok =
+      decode(utterance.data(), utterance.size(), utterance_pos, partial, result);
+
+  result.audio_end =
+      t_audio_end - samples_to_duration((int64_t)pcmf32.size() - end);
+  result.audio_start =
+      result.audio_end - samples_to_duration((int64_t)utterance.size());
+  result.latency_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - t_audio_end)
+                          .count();
+
+  if (!partial) {
+    // a forced cut keeps the utterance open, the rest of the speech is
+    // decoded as the next one
+    in_utterance = !ended;
+    partial_done = false;
+    utterance.clear();
+
+    if (ok) {
+      printf("\n");
+      update_prompt();
+    }
+  }
+
+  return ok;
+}
+
+void STTStream::Impl::publish(STTResult &result) {
+  if (callback) {
+    callback(result);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+
+    // a stale command is worth less than a fresh one
+    if (queue_size == queue.size()) {
+      queue_head = (queue_head + 1) % queue.size();
+      queue_size--;
+    }
+    std::swap(queue[(queue_head + queue_size) % queue.size()], result);
+    queue_size++;
+  }
+
+  queue_cv.notify_one();
+}
+
+// queue_mutex must be held and the queue not empty
+void STTStream::Impl::pop_front(STTResult &result) {
+  std::swap(queue[queue_head], result);
+  queue_head = (queue_head + 1) % queue.size();
+  queue_size--;
+}
+
+void STTStream::Impl::worker_loop() {
+  // reused for every step, see publish()
+  STTResult result;
+
+  while (worker_running) {
+    {
+      std::unique_lock<std::mutex> lock(state_mutex);
+      state_cv.wait(lock, [this] { return !paused || !worker_running; });
+    }
+
+    if (!worker_running) {
+      break;
+    }
+
+    const uint32_t gen = generation.load();
+
+    if (!capture_step(false) || !transcribe(result)) {
+      continue;
+    }
+
+    // drop results for audio that was captured before a pause()
+    if (result.text.empty() || paused || generation.load() != gen) {
+      continue;
+    }
+
+    publish(result);
+  }
 }
 
+std::string STTStream::start_listening() {
+  if (!impl->initialized) {
+    fprintf(stderr, "ERROR: Stream not initialized\n");
+    return "";
+  }
+
+  if (impl->worker_running) {
+    fprintf(stderr, "ERROR: Stream is running in asynchronous mode\n");
+    return "";
+  }
+
+  if (impl->paused) {
+    return "";
+  }
+
+  STTResult result;
+  if (!impl->capture_step(true) || !impl->transcribe(result)) {
+    return "";
+  }
+
+  return result.text;
+}
+
+bool STTStream::start_async(size_t queue_capacity) {
+  if (!impl->initialized) {
+    fprintf(stderr, "ERROR: Stream not initialized\n");
+    return false;
+  }
+
+  if (impl->worker_running) {
+    return true;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(impl->queue_mutex);
+    impl->queue.resize(std::max<size_t>(1, queue_capacity));
+    impl->queue_head = 0;
+    impl->queue_size = 0;
+  }
+  impl->worker_running = true;
+  impl->worker = std::thread(&Impl::worker_loop, impl);
+
+  return true;
+}
+
+void STTStream::stop_async() {
+  if (!impl->worker_running) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(impl->state_mutex);
+    impl->worker_running = false;
+  }
+  impl->state_cv.notify_all();
+
+  if (impl->audio) {
+    impl->audio->wake();
+  }
+
+  if (impl->worker.joinable()) {
+    impl->worker.join();
+  }
+}
+
+bool STTStream::try_pop(STTResult &result) {
+  if (!sdl_poll_events()) {
+    impl->quit = true;
+  }
+
+  std::lock_guard<std::mutex> lock(impl->queue_mutex);
+  if (impl->queue_size == 0) {
+    return false;
+  }
+
+  impl->pop_front(result);
+  return true;
+}
+
+bool STTStream::wait_pop(STTResult &result, int timeout_ms) {
+  if (!sdl_poll_events()) {
+    impl->quit = true;
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock(impl->queue_mutex);
+  if (!impl->queue_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                               [this] { return impl->queue_size > 0; })) {
+    return false;
+  }
+
+  impl->pop_front(result);
+  return true;
+}
+
+void STTStream::set_callback(
+    std::function<void(const STTResult &)> callback) {
+  // only safe to swap while the worker is not running
+  if (impl->worker_running) {
+    fprintf(stderr, "ERROR: Set the callback before start_async()\n");
+    return;
+  }
+
+  impl->callback = std::move(callback);
+}
+
+void STTStream::set_utterance_mode(bool enabled, int partial_ms) {
+  if (impl->worker_running) {
+    fprintf(stderr, "ERROR: Set the utterance mode before start_async()\n");
+    return;
+  }
+
+  impl->params.segment_utterances = enabled;
+  impl->params.partial_ms = std::max(0, partial_ms);
+  impl->n_samples_partial =
+      (1e-3 * impl->params.partial_ms) * WHISPER_SAMPLE_RATE;
+
+  // picks up the hangover and drops any utterance in progress
+  impl->reset_vad();
+}
+
+void STTStream::set_conv_cache(bool enabled, int resync_every) {
+  if (impl->worker_running) {
+    fprintf(stderr, "ERROR: Set the conv cache before start_async()\n");
+    return;
+  }
+
+  impl->params.conv_cache = enabled;
+  impl->params.conv_cache_resync = std::max(0, resync_every);
+  impl->init_wparams();
+}
+
+bool STTStream::quit_requested() const { return impl && impl->quit; }
+
 bool STTStream::listen_for(const std::string &text,
                            const std::string &trigger) {
   std::string text_lower = to_lowercase(text);
@@ -438,30 +1015,32 @@ void STTStream::pause() {
   if (!impl)
     return;
 
-  impl->paused = true;
+  {
+    std::lock_guard<std::mutex> lock(impl->state_mutex);
+    impl->paused = true;
+    impl->generation++;
+  }
 
   if (impl->audio) {
     impl->audio->pause();
     impl->audio->clear();
+    impl->audio->wake();
   }
-
-  impl->pcmf32.clear();
-  impl->pcmf32_old.clear();
-  impl->pcmf32_new.clear();
 }
 
 void STTStream::resume() {
   if (!impl)
     return;
 
-  impl->paused = false;
-
   if (impl->audio) {
     impl->audio->clear();
     impl->audio->resume();
   }
 
-  impl->pcmf32.clear();
-  impl->pcmf32_old.clear();
-  impl->pcmf32_new.clear();
+  {
+    std::lock_guard<std::mutex> lock(impl->state_mutex);
+    impl->paused = false;
+    impl->generation++;
+  }
+  impl->state_cv.notify_all();
 }
@@ -1,6 +1,29 @@
 #pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
 
+// One transcription produced by STTStream.
+struct STTResult {
+  std::string text;
+
+  // Capture time span of the audio window that was decoded
+  std::chrono::steady_clock::time_point audio_start;
+  std::chrono::steady_clock::time_point audio_end;
+
+  // Time from the end of the audio window until the text was available
+  int64_t latency_ms = 0;
+
+  // Mean token probability of the decoded text, 0..1
+  float confidence = 0.0f;
+
+  // Utterance mode only: an early hypothesis for an utterance that is still
+  // being spoken; the final result for it follows
+  bool partial = false;
+};
+
 class STTStream {
 public:
   STTStream();
@@ -16,6 +39,36 @@ public:
   static bool listen_for(const std::string &text, const std::string &trigger);
   std::string start_listening();
 
+  // Asynchronous mode: a worker thread captures and decodes continuously and
+  // publishes non-empty results into a bounded queue (the oldest result is
+  // dropped when it is full). start_listening() is unavailable meanwhile.
+  bool start_async(size_t queue_capacity = 8);
+  void stop_async();
+
+  // Must be called from the thread that owns SDL (they poll SDL events)
+  bool try_pop(STTResult &result);
+  bool wait_pop(STTResult &result, int timeout_ms);
+
+  // Deliver results on the worker thread instead of queueing them.
+  // Must be set before start_async().
+  void set_callback(std::function<void(const STTResult &)> callback);
+
+  // Utterance mode (the default when the VAD model is available) buffers
+  // speech from VAD start to end and decodes each utterance once instead of
+  // re-decoding a sliding window every step. partial_ms > 0 additionally
+  // publishes one partial result once an utterance is that long.
+  // Must be called before start_async().
+  void set_utterance_mode(bool enabled, int partial_ms = 0);
+
+  // Experimental: reuse the encoder conv stem output for the audio that
+  // overlapping windows have in common, so only the new audio goes through
+  // it. Every resync_every-th encode (0 = never) recomputes it in full.
+  // Must be called before start_async().
+  void set_conv_cache(bool enabled, int resync_every = 8);
+
+  // True once SDL reported a quit event (e.g. Ctrl+C)
+  bool quit_requested() const;
+
 private:
   struct Impl;
   Impl *impl;
@@ -0,0 +1,115 @@
+// Compares phoneme -> id lookup through the std::map piper used to keep
+// against the flat phoneme_id_table.
+//
+// usage: tts_bench_phoneme_ids [iterations]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <stdint.h>
+#include <vector>
+#include <phoneme_id_table.hpp>
+
+typedef char32_t Phoneme;
+typedef int64_t PhonemeId;
+typedef std::map<Phoneme, std::vector<PhonemeId>> PhonemeIdMap;
+
+using clock_type = std::chrono::steady_clock;
+
+static double ms_since(clock_type::time_point start) {
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start)
+        .count();
+}
+
+// Symbols of a typical en_US voice: punctuation, ASCII, IPA and a few
+// arrows/bars above the dense range
+static const char32_t *VOICE_PHONEMES =
+    U" !'(),-.:;?abcdefhijklmnopqrstuvwxyzæçðøħŋœǀǁǂǃɐɑɒɓɔɕɖɗɘəɚɛɜɞɟɠɡɢɣɤɥɦɧɨɪɫɬɭɮɯɰ"
+    U"ɱɲɳɴɵɶɸɹɺɻɽɾʀʁʂʃʄʈʉʊʋʌʍʎʏʐʑʒʔʕʘʙʛʜʝʟʡʢʲˈˌːˑ˞βθχᵻⱱ̧̪̩̃"
+    U"↓↑→↗↘‖";
+
+int main(int argc, char **argv) {
+    const int n_iter = argc > 1 ? std::max(1, atoi(argv[1])) : 2000;
+
+    PhonemeIdMap map;
+    std::vector<Phoneme> symbols;
+    PhonemeId next_id = 3;
+    for (const char32_t *p = VOICE_PHONEMES; *p; p++) {
+        map[*p].push_back(next_id++);
+        symbols.push_back(*p);
+    }
+    // a couple of phonemes map to more than one id
+    map[U'ɚ'].push_back(next_id++);
+    map[U'ː'].push_back(next_id++);
+
+    const phoneme_id_table<Phoneme, PhonemeId> table(map);
+
+    // Sentences of ~60 phonemes, about one in twenty not in the map
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<size_t> pick(0, symbols.size() - 1);
+    std::uniform_int_distribution<int> unmapped(0, 19);
+    std::vector<std::vector<Phoneme>> sentences(256);
+    for (auto &sentence : sentences) {
+        sentence.resize(40 + rng() % 40);
+        for (auto &phoneme : sentence) {
+            phoneme = unmapped(rng) == 0 ? U'ʭ' : symbols[pick(rng)];
+        }
+    }
+
+    std::vector<PhonemeId> ids;
+    ids.reserve(256);
+    size_t n_phonemes = 0;
+    int64_t checksum_map = 0;
+    int64_t checksum_table = 0;
+
+    auto start = clock_type::now();
+    for (int iter = 0; iter < n_iter; iter++) {
+        for (const auto &sentence : sentences) {
+            ids.clear();
+            for (Phoneme phoneme : sentence) {
+                auto it = map.find(phoneme);
+                if (it != map.end()) {
+                    for (auto id : it->second) {
+                        ids.push_back(id);
+                    }
+                }
+            }
+            checksum_map += ids.size() + (ids.empty() ? 0 : ids.back());
+            n_phonemes += sentence.size();
+        }
+    }
+    const double t_map = ms_since(start);
+
+    std::vector<phoneme_id_table<Phoneme, PhonemeId>::slot> slots;
+    start = clock_type::now();
+    for (int iter = 0; iter < n_iter; iter++) {
+        for (const auto &sentence : sentences) {
+            ids.clear();
+            slots.resize(sentence.size());
+            table.find_all(sentence.data(), sentence.size(), slots.data());
+            for (const auto &slot : slots) {
+                const PhonemeId *slot_ids = table.ids(slot);
+                ids.insert(ids.end(), slot_ids, slot_ids + slot.count);
+            }
+            checksum_table += ids.size() + (ids.empty() ? 0 : ids.back());
+        }
+    }
+    const double t_table = ms_since(start);
+
+    if (checksum_map != checksum_table) {
+        fprintf(stderr, "Lookups disagree (%lld != %lld)\n",
+                (long long)checksum_map, (long long)checksum_table);
+        return 1;
+    }
+
+    printf("%zu phonemes\n", n_phonemes);
+    printf("%-8s %9.1fms %7.2fns/phoneme\n", "map", t_map,
+           1e6 * t_map / n_phonemes);
+    printf("%-8s %9.1fms %7.2fns/phoneme\n", "table", t_table,
+           1e6 * t_table / n_phonemes);
+    printf("speedup  %9.2fx\n", t_map / t_table);
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+// Measures piper latency under different ONNX Runtime session settings.
+//
+// usage: tts_bench_session [model.onnx] [espeak-ng-data dir] [iterations]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <piper.h>
+
+#ifndef TTS_MODEL_DIR
+#define TTS_MODEL_DIR "models"
+#endif
+#ifndef TTS_ESPEAK_DIR
+#define TTS_ESPEAK_DIR "install/espeak-ng-data"
+#endif
+
+using clock_type = std::chrono::steady_clock;
+
+static double ms_since(clock_type::time_point start) {
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start)
+        .count();
+}
+
+struct bench_case {
+    std::string name;
+    piper_session_config config;
+    int max_chunk_phoneme_ids;
+};
+
+static const char *SENTENCES[] = {
+    "Turn left now.",
+    "In 5 seconds, turn right.",
+    "Navigation paused. Say Start navigation to resume.",
+    "Recalculating. Continue for two kilometers. Then keep left at the fork. "
+    "Your destination will be on the right.",
+};
+
+int main(int argc, char **argv) {
+    const std::string model =
+        argc > 1 ? argv[1] : TTS_MODEL_DIR "/en_US-hfc_male-medium.onnx";
+    const std::string espeak = argc > 2 ? argv[2] : TTS_ESPEAK_DIR;
+    const int n_iter = argc > 3 ? std::max(1, atoi(argv[3])) : 10;
+
+    const std::string optimized_path = model + ".bench.ort";
+    std::remove(optimized_path.c_str());
+
+    std::vector<bench_case> cases;
+    auto add = [&](const char *name, auto &&edit, int max_chunk = 0) {
+        piper_session_config config = piper_default_session_config();
+        edit(config);
+        cases.push_back({name, config, max_chunk});
+    };
+
+    add("defaults", [](piper_session_config &) {});
+    add("no arena, no mem pattern (old)", [](piper_session_config &c) {
+        c.enable_cpu_mem_arena = false;
+        c.enable_mem_pattern = false;
+    });
+    add("no arena", [](piper_session_config &c) { c.enable_cpu_mem_arena = false; });
+    add("no mem pattern", [](piper_session_config &c) { c.enable_mem_pattern = false; });
+    add("intra_op 1", [](piper_session_config &c) { c.intra_op_num_threads = 1; });
+    add("intra_op 2", [](piper_session_config &c) { c.intra_op_num_threads = 2; });
+    add("intra_op 4", [](piper_session_config &c) { c.intra_op_num_threads = 4; });
+    add("intra_op 2, pinned", [](piper_session_config &c) {
+        c.intra_op_num_threads = 2;
+        c.intra_op_thread_affinities = "1";
+    });
+    add("parallel mode, inter_op 2", [](piper_session_config &c) {
+        c.execution_mode = 1; // parallel
+        c.inter_op_num_threads = 2;
+    });
+    add("no spinning", [](piper_session_config &c) { c.allow_spinning = false; });
+    add("graph opt disabled", [](piper_session_config &c) { c.graph_optimization_level = 0; });
+    add("graph opt basic", [](piper_session_config &c) { c.graph_optimization_level = 1; });
+    add("graph opt extended", [](piper_session_config &c) { c.graph_optimization_level = 2; });
+    add("parallel 2", [](piper_session_config &c) { c.parallel_sentences = 2; });
+    add("parallel 3", [](piper_session_config &c) { c.parallel_sentences = 3; });
+    add("parallel 2, intra_op 2", [](piper_session_config &c) {
+        c.parallel_sentences = 2;
+        c.intra_op_num_threads = 2;
+    });
+    add("chunks of 100 ids", [](piper_session_config &) {}, 100);
+    add("chunks of 60 ids", [](piper_session_config &) {}, 60);
+    add("optimized model (write)", [&](piper_session_config &c) {
+        c.optimized_model_path = optimized_path.c_str();
+    });
+    add("optimized model (load)", [&](piper_session_config &c) {
+        c.optimized_model_path = optimized_path.c_str();
+    });
+
+    // "ttfa" is the mean time until the first chunk of a sentence,
+    // "overhead" is the time per run spent in piper_synthesize_next outside
+    // of the onnxruntime session run
+    printf("%-32s %9s %9s %9s %9s %9s %7s %10s\n", "config", "create", "first",
+           "mean", "p95", "ttfa", "rtf", "overhead");
+
+    for (const bench_case &bc : cases) {
+        auto start = clock_type::now();
+        piper_synthesizer *synth = piper_create(model.c_str(), nullptr,
+                                                espeak.c_str(), &bc.config);
+        if (!synth) {
+            fprintf(stderr, "Failed to load %s\n", model.c_str());
+            return 1;
+        }
+        const double t_create = ms_since(start);
+
+        piper_synthesize_options opts = piper_default_synthesize_options(synth);
+        opts.max_chunk_phoneme_ids = bc.max_chunk_phoneme_ids;
+        piper_audio_chunk chunk;
+
+        // first run includes lazy initialization inside ONNX Runtime
+        double t_first = 0.0;
+        std::vector<double> t_runs;
+        double t_total = 0.0;
+        double t_first_chunk = 0.0;
+        size_t n_samples = 0;
+        int sample_rate = 22050;
+
+        for (int iter = 0; iter <= n_iter; iter++) {
+            for (const char *text : SENTENCES) {
+                start = clock_type::now();
+                piper_synthesize_start(synth, text, &opts);
+                bool first_chunk = true;
+                while (piper_synthesize_next(synth, &chunk) != PIPER_DONE) {
+                    if (iter > 0 && first_chunk) {
+                        t_first_chunk += ms_since(start);
+                        first_chunk = false;
+                    }
+                    if (iter > 0) {
+                        n_samples += chunk.num_samples;
+                        sample_rate = chunk.sample_rate;
+                    }
+                }
+                const double t = ms_since(start);
+
+                if (iter == 0) {
+                    t_first = std::max(t_first, t);
+                    piper_reset_timings(synth);
+                } else {
+                    t_runs.push_back(t);
+                    t_total += t;
+                }
+            }
+        }
+
+        const piper_timings timings = piper_get_timings(synth);
+        piper_free(synth);
+
+        std::sort(t_runs.begin(), t_runs.end());
+        const double mean = t_total / t_runs.size();
+        const double ttfa = t_first_chunk / t_runs.size();
+        const double p95 = t_runs[(t_runs.size() * 95) / 100];
+        const double rtf = (t_total / 1000.0) / ((double)n_samples / sample_rate);
+
+        const double overhead_us =
+            timings.num_runs > 0
+                ? 1000.0 * timings.overhead_ms / timings.num_runs
+                : 0.0;
+
+        printf("%-32s %7.1fms %7.1fms %7.1fms %7.1fms %7.1fms %7.3f %8.1fus\n",
+               bc.name.c_str(), t_create, t_first, mean, p95, ttfa, rtf,
+               overhead_us);
+    }
+
+    std::remove(optimized_path.c_str());
+
+    // Throughput of piper_synthesize_batch with the default session
+    printf("\n%-32s %9s %7s\n", "batch size", "total", "rtf");
+
+    std::vector<const char *> texts;
+    for (int iter = 0; iter < n_iter; iter++) {
+        texts.insert(texts.end(), std::begin(SENTENCES), std::end(SENTENCES));
+    }
+    std::vector<piper_audio_chunk> chunks(texts.size());
+
+    piper_synthesizer *synth =
+        piper_create(model.c_str(), nullptr, espeak.c_str(), nullptr);
+    if (!synth) {
+        fprintf(stderr, "Failed to load %s\n", model.c_str());
+        return 1;
+    }
+
+    for (size_t batch_size : {1, 2, 4, 8, 16}) {
+        // warm up with this batch shape
+        piper_synthesize_batch(synth, texts.data(), 1, nullptr, batch_size,
+                               chunks.data());
+
+        auto start = clock_type::now();
+        if (piper_synthesize_batch(synth, texts.data(), texts.size(), nullptr,
+                                   batch_size, chunks.data()) != PIPER_OK) {
+            fprintf(stderr, "Batch synthesis failed\n");
+            break;
+        }
+        const double t = ms_since(start);
+
+        size_t n_samples = 0;
+        for (const auto &chunk : chunks) {
+            n_samples += chunk.num_samples;
+        }
+        const double rtf = (t / 1000.0) / ((double)n_samples / chunks[0].sample_rate);
+
+        printf("%-32zu %7.1fms %7.3f\n", batch_size, t, rtf);
+    }
+
+    piper_free(synth);
+    return 0;
+}
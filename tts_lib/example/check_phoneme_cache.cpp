@@ -0,0 +1,89 @@
+// Checks that the phoneme memo returns the sentences of the text that was
+// looked up. Two texts are synthesized in one batch, which memoizes both, and
+// then each is synthesized alone. The phoneme ids of every chunk must match a
+// synthesizer with the memo disabled.
+//
+// usage: tts_check_phoneme_cache [model.onnx] [espeak-ng-data dir]
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <piper.h>
+
+#ifndef TTS_MODEL_DIR
+#define TTS_MODEL_DIR "models"
+#endif
+#ifndef TTS_ESPEAK_DIR
+#define TTS_ESPEAK_DIR "install/espeak-ng-data"
+#endif
+
+static const char *TEXTS[] = {
+    "Turn left now. Then keep right.",
+    "Recalculating.",
+};
+
+// Phoneme ids of each chunk piper_synthesize_next returns for text
+static bool chunk_ids(piper_synthesizer *synth, const char *text,
+                      std::vector<std::vector<int>> &ids) {
+    ids.clear();
+    if (piper_synthesize_start(synth, text, nullptr) != PIPER_OK) {
+        return false;
+    }
+
+    piper_audio_chunk chunk;
+    int result;
+    while ((result = piper_synthesize_next(synth, &chunk)) == PIPER_OK) {
+        ids.emplace_back(chunk.phoneme_ids,
+                         chunk.phoneme_ids + chunk.num_phoneme_ids);
+    }
+
+    return result == PIPER_DONE;
+}
+
+int main(int argc, char **argv) {
+    const std::string model =
+        argc > 1 ? argv[1] : TTS_MODEL_DIR "/en_US-hfc_male-medium.onnx";
+    const std::string espeak = argc > 2 ? argv[2] : TTS_ESPEAK_DIR;
+
+    piper_session_config config = piper_default_session_config();
+    piper_synthesizer *synth =
+        piper_create(model.c_str(), nullptr, espeak.c_str(), &config);
+
+    config.phoneme_cache_size = 0;
+    piper_synthesizer *reference =
+        piper_create(model.c_str(), nullptr, espeak.c_str(), &config);
+
+    if (!synth || !reference) {
+        fprintf(stderr, "Failed to load %s\n", model.c_str());
+        return 1;
+    }
+
+    const size_t n_texts = sizeof(TEXTS) / sizeof(TEXTS[0]);
+    std::vector<piper_audio_chunk> chunks(n_texts);
+    if (piper_synthesize_batch(synth, TEXTS, n_texts, nullptr, 0,
+                               chunks.data()) != PIPER_OK) {
+        fprintf(stderr, "Failed to synthesize the batch\n");
+        return 1;
+    }
+
+    int n_failed = 0;
+
+    for (size_t i = 0; i < n_texts; i++) {
+        std::vector<std::vector<int>> got;
+        std::vector<std::vector<int>> expected;
+        if (!chunk_ids(synth, TEXTS[i], got) ||
+            !chunk_ids(reference, TEXTS[i], expected)) {
+            fprintf(stderr, "Failed to synthesize \"%s\"\n", TEXTS[i]);
+            return 1;
+        }
+
+        const bool ok = got == expected;
+        printf("%-4s \"%s\": %zu chunks, expected %zu\n", ok ? "ok" : "FAIL",
+               TEXTS[i], got.size(), expected.size());
+        n_failed += ok ? 0 : 1;
+    }
+
+    piper_free(reference);
+    piper_free(synth);
+
+    return n_failed == 0 ? 0 : 1;
+}
@@ -8,7 +8,8 @@ int main() {
     auto *synth = piper_create(
         "models/en_US-amy-medium.onnx",
         "models/en_US-amy-medium.onnx.json",
-        "install/espeak-ng-data"
+        "install/espeak-ng-data",
+        nullptr
     );
 
     std::cout << "Model loaded. (type \"quit\" or \"exit\" to leave.):\n" << std::endl;
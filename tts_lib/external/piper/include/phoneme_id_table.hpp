@@ -0,0 +1,92 @@
+#ifndef PHONEME_ID_TABLE_H_
+#define PHONEME_ID_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Flat phoneme -> ids lookup built once from the voice's phoneme_id_map.
+//
+// Every phoneme's ids live in one contiguous array and are referenced by an
+// (offset, count) slot. Codepoints below DENSE_SIZE (Latin, IPA extensions,
+// spacing modifiers and combining marks) index a dense slot array that fits in
+// L1; the few phonemes above it go through a hash map. Unmapped phonemes
+// have count 0.
+template <typename PhonemeT, typename IdT> class phoneme_id_table {
+  public:
+    struct slot {
+        uint32_t offset = 0;
+        uint32_t count = 0;
+    };
+
+    static constexpr uint32_t DENSE_SIZE = 0x800;
+
+    // One slot past the dense range stays empty, find_all maps codepoints
+    // above the range there
+    phoneme_id_table() : m_dense(DENSE_SIZE + 1) {}
+
+    // map is any range of (phoneme, std::vector<IdT>) pairs
+    template <typename MapT> explicit phoneme_id_table(const MapT &map)
+        : m_dense(DENSE_SIZE + 1) {
+        for (const auto &[phoneme, ids] : map) {
+            slot s;
+            s.offset = (uint32_t)m_ids.size();
+            s.count = (uint32_t)ids.size();
+            m_ids.insert(m_ids.end(), ids.begin(), ids.end());
+
+            if ((uint32_t)phoneme < DENSE_SIZE) {
+                m_dense[(uint32_t)phoneme] = s;
+            } else {
+                m_sparse[(uint32_t)phoneme] = s;
+            }
+        }
+    }
+
+    slot find(PhonemeT phoneme) const {
+        const uint32_t cp = (uint32_t)phoneme;
+        if (cp < DENSE_SIZE) {
+            return m_dense[cp];
+        }
+
+        auto it = m_sparse.find(cp);
+        return it != m_sparse.end() ? it->second : slot{};
+    }
+
+    // Looks up a whole sentence. The dense pass has no branches or calls so
+    // the compiler can vectorize it (gathers on AVX2). Codepoints above the
+    // dense range read the empty sentinel slot and, if the voice has any
+    // such phonemes, are patched up afterwards.
+    void find_all(const PhonemeT *phonemes, size_t n, slot *slots) const {
+        const slot *dense = m_dense.data();
+        bool any_sparse = false;
+
+        for (size_t i = 0; i < n; i++) {
+            const uint32_t cp = (uint32_t)phonemes[i];
+            const bool in_dense = cp < DENSE_SIZE;
+            slots[i] = dense[in_dense ? cp : DENSE_SIZE];
+            any_sparse |= !in_dense;
+        }
+
+        if (!any_sparse || m_sparse.empty()) {
+            return;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            if ((uint32_t)phonemes[i] >= DENSE_SIZE) {
+                slots[i] = find(phonemes[i]);
+            }
+        }
+    }
+
+    const IdT *ids(slot s) const { return m_ids.data() + s.offset; }
+
+    bool empty() const { return m_ids.empty(); }
+
+  private:
+    std::vector<slot> m_dense;
+    std::unordered_map<uint32_t, slot> m_sparse;
+    std::vector<IdT> m_ids;
+};
+
+#endif // PHONEME_ID_TABLE_H_
@@ -25,6 +25,10 @@ typedef struct piper_synthesizer piper_synthesizer;
 typedef struct piper_audio_chunk {
   /**
    * \brief Raw samples returned from the voice model.
+   *
+   * Points directly into the model's output tensor, so copying it out (e.g.
+   * into a playback buffer) is the only copy made. Valid until the next call
+   * to piper_synthesize_next or piper_synthesize_start.
    */
   const float *samples;
 
@@ -140,8 +144,125 @@ typedef struct piper_synthesize_options {
    * For multi-speaker models, a value of 0.333 is usually good.
    */
   float noise_w_scale;
+
+  /**
+   * \brief Maximum number of phoneme ids synthesized in one model run.
+   *
+   * 0 (the default) synthesizes whole sentences. Otherwise longer sentences
+   * are split into chunks of at most this many ids, preferably after a comma,
+   * colon or semicolon and otherwise between words. Each chunk is returned by
+   * its own piper_synthesize_next call and consecutive chunks are joined with
+   * a short crossfade, so the time until the first audio depends on this
+   * budget instead of the sentence length. Prosody restarts at each chunk;
+   * about 100 ids (50 phonemes) is a reasonable trade-off.
+   */
+  int max_chunk_phoneme_ids;
 } piper_synthesize_options;
 
+/**
+ * \brief ONNX Runtime session settings for a synthesizer.
+ *
+ * \sa \ref piper_default_session_config
+ */
+typedef struct piper_session_config {
+  /**
+   * \brief Use ONNX Runtime's arena allocator for intermediate tensors.
+   *
+   * Avoids a malloc/free per tensor on every run at the cost of keeping the
+   * peak working set allocated. The default is true.
+   */
+  bool enable_cpu_mem_arena;
+
+  /**
+   * \brief Reuse the memory plan of previous runs with the same input shapes.
+   *
+   * The default is true.
+   */
+  bool enable_mem_pattern;
+
+  /**
+   * \brief Threads used to parallelize a single operator.
+   *
+   * 0 lets ONNX Runtime decide (one per physical core). Set this lower when
+   * other work, e.g. speech recognition, shares the CPU.
+   */
+  int intra_op_num_threads;
+
+  /**
+   * \brief Threads used to run independent operators in parallel.
+   *
+   * Only used with the parallel execution mode. 0 lets ONNX Runtime decide.
+   */
+  int inter_op_num_threads;
+
+  /**
+   * \brief Execution mode.
+   *
+   * Same values as ONNX Runtime's ExecutionMode: 0 = sequential (the default),
+   * 1 = parallel. Parallel runs independent branches of the graph on the
+   * inter-op thread pool, which helps little for a mostly sequential graph.
+   */
+  int execution_mode;
+
+  /**
+   * \brief Whether idle intra-op threads spin before sleeping.
+   *
+   * Spinning lowers latency but burns CPU that other threads could use.
+   * The default is true.
+   */
+  bool allow_spinning;
+
+  /**
+   * \brief Graph optimization level.
+   *
+   * Same values as ONNX Runtime's GraphOptimizationLevel:
+   * 0 = disabled, 1 = basic, 2 = extended, 99 = all (the default).
+   */
+  int graph_optimization_level;
+
+  /**
+   * \brief Path of a cached, optimized copy of the model or NULL.
+   *
+   * If the file exists it is loaded instead of the model with graph
+   * optimizations disabled, which skips the optimization work at startup.
+   * Otherwise the optimized model is written there when the session is
+   * created. The file is specific to the ONNX Runtime version and CPU.
+   */
+  const char *optimized_model_path;
+
+  /**
+   * \brief CPU affinity of the intra-op threads or NULL.
+   *
+   * ONNX Runtime's "session.intra_op_thread_affinities" syntax: one entry per
+   * thread except the caller, separated by ';', each a core list like "1,2"
+   * or a range like "1-3". Requires intra_op_num_threads to be set.
+   */
+  const char *intra_op_thread_affinities;
+
+  /**
+   * \brief Number of sentences synthesized at the same time.
+   *
+   * With 1 (the default) each sentence is synthesized by the
+   * piper_synthesize_next call that returns it. With N > 1,
+   * piper_synthesize_start hands the first N sentences to worker threads that
+   * share the session, and each piper_synthesize_next returns the next
+   * sentence in text order while starting another one. The caller can play
+   * sentence K while the following sentences are synthesized, and a long
+   * prompt takes about as long as its slowest sentences rather than their
+   * sum. The runs share the intra-op thread pool, so consider lowering
+   * intra_op_num_threads.
+   */
+  int parallel_sentences;
+
+  /**
+   * \brief Number of phonemized texts remembered by piper_synthesize_start.
+   *
+   * Synthesizing a text that is still remembered skips espeak-ng and the
+   * phoneme id lookup. The default is 256; 0 disables the cache.
+   */
+  int phoneme_cache_size;
+} piper_session_config;
+
 /**
  * \brief Create a Piper text-to-speech synthesizer from a voice model.
  *
@@ -153,10 +274,21 @@ typedef struct piper_synthesize_options {
  * \param espeak_data_path path to the espeak-ng data
  * directory.
  *
+ * \param session_config ONNX Runtime session settings or NULL for defaults.
+ *
  * \return a Piper text-to-speech synthesizer for the voice model.
  */
 piper_synthesizer *piper_create(const char *model_path, const char *config_path,
-                                const char *espeak_data_path);
+                                const char *espeak_data_path,
+                                const piper_session_config *session_config);
+
+/**
+ * \brief Get the default ONNX Runtime session settings.
+ *
+ * \return session settings with the arena and memory patterns enabled and
+ * thread counts left to ONNX Runtime.
+ */
+piper_session_config piper_default_session_config(void);
 
 /**
  * \brief Free resources for Piper synthesizer.
@@ -210,6 +342,81 @@ int piper_synthesize_start(piper_synthesizer *synth, const char *text,
  */
 int piper_synthesize_next(piper_synthesizer *synth, piper_audio_chunk *chunk);
 
+/**
+ * \brief Synthesize several texts with batched model runs.
+ *
+ * The sentences of all texts are phonemized, sorted by length and padded
+ * into batches of up to max_batch_size sentences, each synthesized by a
+ * single model run. The padded output is split back into sentences using the
+ * model's alignments; voices exported without alignments are run one
+ * sentence at a time. Meant for throughput (filling a phrase cache,
+ * rendering prompts offline), not for latency.
+ *
+ * Does not affect synthesis started with piper_synthesize_start.
+ *
+ * \param synth Piper synthesizer.
+ *
+ * \param texts texts to synthesize.
+ *
+ * \param num_texts number of texts.
+ *
+ * \param options synthesis options or NULL for defaults
+ * (max_chunk_phoneme_ids is ignored).
+ *
+ * \param max_batch_size most sentences per model run or 0 for the default.
+ *
+ * \param chunks array of num_texts chunks. chunks[i] receives the complete
+ * audio of texts[i]; only samples, num_samples, sample_rate and is_last are
+ * set. The samples are valid until the next call to piper_synthesize_batch.
+ *
+ * \return PIPER_OK or error code.
+ */
+int piper_synthesize_batch(piper_synthesizer *synth, const char *const *texts,
+                           size_t num_texts,
+                           const piper_synthesize_options *options,
+                           size_t max_batch_size, piper_audio_chunk *chunks);
+
+/**
+ * \brief Time spent in a synthesizer since it was created or reset.
+ */
+typedef struct piper_timings {
+  /**
+   * \brief Time in piper_synthesize_start (phonemization).
+   */
+  double phonemize_ms;
+
+  /**
+   * \brief Time inside the ONNX Runtime session runs.
+   */
+  double run_ms;
+
+  /**
+   * \brief Time in piper_synthesize_next outside the session runs.
+   */
+  double overhead_ms;
+
+  /**
+   * \brief Number of session runs.
+   */
+  size_t num_runs;
+} piper_timings;
+
+/**
+ * \brief Get the accumulated timings of a Piper synthesizer.
+ *
+ * \param synth Piper synthesizer.
+ *
+ * \sa \ref piper_reset_timings
+ */
+piper_timings piper_get_timings(piper_synthesizer *synth);
+
+/**
+ * \brief Reset the accumulated timings of a Piper synthesizer.
+ *
+ * \param synth Piper synthesizer.
+ */
+void piper_reset_timings(piper_synthesizer *synth);
+
 #ifdef __cplusplus
 }
 #endif
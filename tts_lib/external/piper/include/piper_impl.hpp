@@ -2,14 +2,20 @@
 #define PIPER_IMPL_H_
 
 #include "json.hpp"
+#include "phoneme_id_table.hpp"
 #include "uni_algo.h"
 
+#include <chrono>
+#include <deque>
+#include <future>
+#include <list>
 #include <map>
 #include <memory>
 #include <optional>
 #include <queue>
 #include <stdint.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <onnxruntime_cxx_api.h>
@@ -18,6 +24,7 @@ typedef char32_t Phoneme;
 typedef int64_t PhonemeId;
 typedef int64_t SpeakerId;
 typedef std::map<Phoneme, std::vector<PhonemeId>> PhonemeIdMap;
+typedef phoneme_id_table<Phoneme, PhonemeId> PhonemeIdTable;
 
 const PhonemeId ID_PAD = 0; // interleaved
 const PhonemeId ID_BOS = 1; // beginning of sentence
@@ -34,6 +41,9 @@ const float DEFAULT_NOISE_W_SCALE = 0.8f;
 
 const int DEFAULT_HOP_LENGTH = 256;
 
+// Sentences per model run in piper_synthesize_batch
+const size_t DEFAULT_BATCH_SIZE = 8;
+
 // onnx
 Ort::Env ort_env{ORT_LOGGING_LEVEL_WARNING, "piper"};
 
@@ -54,12 +64,36 @@ Ort::Env ort_env{ORT_LOGGING_LEVEL_WARNING, "piper"};
 #define CLAUSE_COLON (30 | CLAUSE_INTONATION_FULL_STOP | CLAUSE_TYPE_CLAUSE)
 #define CLAUSE_SEMICOLON (30 | CLAUSE_INTONATION_COMMA | CLAUSE_TYPE_CLAUSE)
 
+// Length of the crossfade between chunks of a sentence
+const int CHUNK_CROSSFADE_MS = 10;
+
+// Unit of synthesis: a sentence, or part of one when chunking is enabled
+struct piper_sentence {
+    std::vector<Phoneme> phonemes;
+    std::vector<PhonemeId> ids;
+
+    // True if the next sentence continues this one, so the audio of the two
+    // is crossfaded instead of just concatenated
+    bool crossfade_next = false;
+};
+
+// A sentence handed to a worker thread when parallel_sentences > 1. The job
+// owns its input buffers, so concurrent runs share nothing but the session.
+struct piper_sentence_job {
+    piper_sentence sentence;
+    int64_t lengths[1] = {0};
+    float scales[3] = {DEFAULT_NOISE_SCALE, DEFAULT_LENGTH_SCALE,
+                       DEFAULT_NOISE_W_SCALE};
+    int64_t sid[1] = {0};
+    std::vector<Ort::Value> outputs;
+};
+
 struct piper_synthesizer {
     // From config JSON file
     std::string espeak_voice;
     int sample_rate;
     int num_speakers;
-    PhonemeIdMap phoneme_id_map;
+    PhonemeIdTable phoneme_id_table;
     int hop_length = DEFAULT_HOP_LENGTH;
 
     // Default synthesis settings for the voice
@@ -73,17 +107,61 @@ struct piper_synthesizer {
     Ort::SessionOptions session_options;
     Ort::Env session_env;
 
+    // Resolved once in piper_create, reused by every run
+    std::vector<std::string> output_names;
+    std::vector<const char *> output_name_ptrs;
+    Ort::MemoryInfo memory_info{nullptr};
+    std::unique_ptr<Ort::IoBinding> io_binding;
+
+    // Input buffers bound to io_binding. The small inputs are bound once and
+    // only their values change; the phoneme id buffer is rebound per
+    // sentence and grows geometrically, so it stops reallocating quickly.
+    std::vector<PhonemeId> input_ids;
+    int64_t input_lengths[1] = {0};
+    float input_scales[3] = {DEFAULT_NOISE_SCALE, DEFAULT_LENGTH_SCALE,
+                             DEFAULT_NOISE_W_SCALE};
+    int64_t input_sid[1] = {0};
+    Ort::Value lengths_tensor{nullptr};
+    Ort::Value scales_tensor{nullptr};
+    Ort::Value sid_tensor{nullptr};
+
+    // Sentences run concurrently on the session (1 = on the caller thread)
+    int parallel_sentences = 1;
+
+    // Phonemized texts, most recently used first
+    size_t phoneme_cache_size = 0;
+    std::list<std::pair<std::string, std::vector<piper_sentence>>>
+        phoneme_cache;
+    std::unordered_map<
+        std::string,
+        std::list<std::pair<std::string, std::vector<piper_sentence>>>::iterator>
+        phoneme_cache_index;
+
+    // Timings since the last piper_reset_timings
+    std::chrono::steady_clock::duration t_phonemize{0};
+    std::chrono::steady_clock::duration t_run{0};
+    std::chrono::steady_clock::duration t_next{0};
+    size_t n_runs = 0;
+
     // synthesize state
-    std::queue<std::pair<std::vector<Phoneme>, std::vector<PhonemeId>>>
-        phoneme_id_queue;
-    std::vector<float> chunk_samples;
+    std::queue<piper_sentence> phoneme_id_queue;
+    std::vector<Ort::Value> chunk_outputs;
+    std::vector<float> chunk_tail; // held back for the crossfade
     std::vector<int> chunk_phoneme_ids;
     std::vector<Phoneme> chunk_phonemes;
     std::vector<int> chunk_alignments;
+
+    // piper_synthesize_batch results, one per text
+    std::vector<std::vector<float>> batch_audio;
     float length_scale = DEFAULT_LENGTH_SCALE;
     float noise_scale = DEFAULT_NOISE_SCALE;
     float noise_w_scale = DEFAULT_NOISE_W_SCALE;
     SpeakerId speaker_id = 0;
+    int max_chunk_phoneme_ids = 0;
+
+    // In-flight sentences in text order, at most parallel_sentences. Declared
+    // after the session so that destroying it waits for them first.
+    std::deque<std::future<piper_sentence_job>> pending_sentences;
 };
 
 // Get the first UTF-8 codepoint of a string
@@ -1,17 +1,104 @@
 #include "piper.h"
 #include "piper_impl.hpp"
 
+#include <algorithm>
 #include <array>
 #include <fstream>
+#include <iterator>
 #include <limits>
+#include <mutex>
 
 #include <espeak-ng/speak_lib.h>
 
 using json = nlohmann::json;
 
-struct piper_synthesizer *piper_create(const char *model_path,
-                                       const char *config_path,
-                                       const char *espeak_data_path) {
+piper_session_config piper_default_session_config(void) {
+    piper_session_config config;
+    config.enable_cpu_mem_arena = true;
+    config.enable_mem_pattern = true;
+    config.intra_op_num_threads = 0;
+    config.inter_op_num_threads = 0;
+    config.execution_mode = ExecutionMode::ORT_SEQUENTIAL;
+    config.allow_spinning = true;
+    config.graph_optimization_level = GraphOptimizationLevel::ORT_ENABLE_ALL;
+    config.optimized_model_path = nullptr;
+    config.intra_op_thread_affinities = nullptr;
+    config.parallel_sentences = 1;
+    config.phoneme_cache_size = 256;
+
+    return config;
+}
+
+// espeak-ng is process-global: the voice set by one synthesizer is the voice
+// of all of them, so each phonemization sets its own if another one is active
+static std::mutex espeak_mutex;
+static std::string espeak_current_voice; // guarded by espeak_mutex
+
+static bool file_exists(const char *path) {
+    std::ifstream stream(path, std::ios::binary);
+    return stream.good();
+}
+
+// Applies session_config and returns the path of the model to load
+static const char *
+apply_session_config(Ort::SessionOptions &options, const char *model_path,
+                     const piper_session_config &session_config) {
+    if (session_config.enable_cpu_mem_arena) {
+        options.EnableCpuMemArena();
+    } else {
+        options.DisableCpuMemArena();
+    }
+
+    if (session_config.enable_mem_pattern) {
+        options.EnableMemPattern();
+    } else {
+        options.DisableMemPattern();
+    }
+
+    if (session_config.intra_op_num_threads > 0) {
+        options.SetIntraOpNumThreads(session_config.intra_op_num_threads);
+    }
+
+    options.SetExecutionMode(
+        static_cast<ExecutionMode>(session_config.execution_mode));
+
+    if (session_config.inter_op_num_threads > 0) {
+        options.SetInterOpNumThreads(session_config.inter_op_num_threads);
+    }
+
+    options.AddConfigEntry("session.intra_op.allow_spinning",
+                           session_config.allow_spinning ? "1" : "0");
+    options.AddConfigEntry("session.inter_op.allow_spinning",
+                           session_config.allow_spinning ? "1" : "0");
+
+    if (session_config.intra_op_thread_affinities &&
+        session_config.intra_op_thread_affinities[0] != '\0') {
+        options.AddConfigEntry("session.intra_op_thread_affinities",
+                               session_config.intra_op_thread_affinities);
+    }
+
+    options.SetGraphOptimizationLevel(static_cast<GraphOptimizationLevel>(
+        session_config.graph_optimization_level));
+
+    const char *optimized_path = session_config.optimized_model_path;
+    if (optimized_path && optimized_path[0] != '\0') {
+        if (file_exists(optimized_path)) {
+            // Already optimized
+            options.SetGraphOptimizationLevel(
+                GraphOptimizationLevel::ORT_DISABLE_ALL);
+            return optimized_path;
+        }
+
+        options.SetOptimizedModelFilePath(optimized_path);
+    }
+
+    return model_path;
+}
+
+struct piper_synthesizer *
+piper_create(const char *model_path, const char *config_path,
+             const char *espeak_data_path,
+             const piper_session_config *session_config) {
     if (!model_path) {
         return nullptr;
     }
@@ -27,9 +114,13 @@ struct piper_synthesizer *piper_create(const char *model_path,
     std::ifstream config_stream(config_path_str);
     auto config = json::parse(config_stream);
 
-    if (espeak_Initialize(AUDIO_OUTPUT_SYNCHRONOUS, 0, espeak_data_path, 0) <
-        0) {
-        return nullptr;
+    {
+        std::lock_guard<std::mutex> espeak_lock(espeak_mutex);
+        espeak_current_voice.clear();
+        if (espeak_Initialize(AUDIO_OUTPUT_SYNCHRONOUS, 0, espeak_data_path,
+                              0) < 0) {
+            return nullptr;
+        }
     }
 
     piper_synthesizer *synth = new piper_synthesizer();
@@ -53,6 +144,7 @@ struct piper_synthesizer *piper_create(const char *model_path,
 
     // phoneme to [id] map
     // Maps phonemes to one or more phoneme ids (required).
+    PhonemeIdMap phoneme_id_map;
     if (config.contains("phoneme_id_map")) {
         auto &phoneme_id_map_value = config["phoneme_id_map"];
         for (auto &from_phoneme_item : phoneme_id_map_value.items()) {
@@ -65,11 +157,14 @@ struct piper_synthesizer *piper_create(const char *model_path,
 
             for (auto &to_id_value : from_phoneme_item.value()) {
                 PhonemeId to_id = to_id_value.get<PhonemeId>();
-                synth->phoneme_id_map[*from_codepoint].push_back(to_id);
+                phoneme_id_map[*from_codepoint].push_back(to_id);
             }
         }
     }
 
+    // Flattened for lookups while phonemizing
+    synth->phoneme_id_table = PhonemeIdTable(phoneme_id_map);
+
     synth->num_speakers = config["num_speakers"].get<SpeakerId>();
 
     if (config.contains("inference")) {
@@ -92,18 +187,64 @@ struct piper_synthesizer *piper_create(const char *model_path,
     }
 
     // Load onnx model
-    synth->session_options.DisableCpuMemArena();
-    synth->session_options.DisableMemPattern();
+    piper_session_config default_session_config;
+    if (!session_config) {
+        default_session_config = piper_default_session_config();
+        session_config = &default_session_config;
+    }
+
     synth->session_options.DisableProfiling();
+    const char *session_model_path = apply_session_config(
+        synth->session_options, model_path, *session_config);
 
     synth->session = std::make_unique<Ort::Session>(
-        Ort::Session(ort_env, model_path, synth->session_options));
+        Ort::Session(ort_env, session_model_path, synth->session_options));
+
+    // Resolve everything that does not change between runs
+    synth->output_names = synth->session->GetOutputNames();
+    for (const auto &name : synth->output_names) {
+        synth->output_name_ptrs.push_back(name.c_str());
+    }
+    synth->memory_info = Ort::MemoryInfo::CreateCpu(
+        OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+    synth->io_binding = std::make_unique<Ort::IoBinding>(*synth->session);
+
+    const int64_t lengths_shape[] = {1};
+    synth->lengths_tensor = Ort::Value::CreateTensor<int64_t>(
+        synth->memory_info, synth->input_lengths, 1, lengths_shape, 1);
+    synth->io_binding->BindInput("input_lengths", synth->lengths_tensor);
+
+    const int64_t scales_shape[] = {3};
+    synth->scales_tensor = Ort::Value::CreateTensor<float>(
+        synth->memory_info, synth->input_scales, 3, scales_shape, 1);
+    synth->io_binding->BindInput("scales", synth->scales_tensor);
+
+    if (synth->num_speakers > 1) {
+        const int64_t sid_shape[] = {1};
+        synth->sid_tensor = Ort::Value::CreateTensor<int64_t>(
+            synth->memory_info, synth->input_sid, 1, sid_shape, 1);
+        synth->io_binding->BindInput("sid", synth->sid_tensor);
+    }
+
+    // Output shapes depend on the sentence, let onnxruntime allocate them
+    for (const auto &name : synth->output_names) {
+        synth->io_binding->BindOutput(name.c_str(), synth->memory_info);
+    }
+
+    synth->input_ids.reserve(256);
+    synth->parallel_sentences = std::max(1, session_config->parallel_sentences);
+    synth->phoneme_cache_size =
+        (size_t)std::max(0, session_config->phoneme_cache_size);
 
     return synth;
 }
 
 void piper_free(struct piper_synthesizer *synth) {
-    espeak_Terminate();
+    {
+        std::lock_guard<std::mutex> espeak_lock(espeak_mutex);
+        espeak_Terminate();
+        espeak_current_voice.clear();
+    }
 
     if (!synth) {
         return;
@@ -119,6 +260,7 @@ piper_default_synthesize_options(piper_synthesizer *synth) {
     options.length_scale = DEFAULT_LENGTH_SCALE;
     options.noise_scale = DEFAULT_NOISE_SCALE;
     options.noise_w_scale = DEFAULT_NOISE_W_SCALE;
+    options.max_chunk_phoneme_ids = 0;
 
     if (synth) {
         options.length_scale = synth->synth_length_scale;
@@ -129,38 +271,181 @@ piper_default_synthesize_options(piper_synthesizer *synth) {
     return options;
 }
 
-int piper_synthesize_start(struct piper_synthesizer *synth, const char *text,
-                           const piper_synthesize_options *options) {
+piper_timings piper_get_timings(piper_synthesizer *synth) {
+    piper_timings timings = {};
     if (!synth) {
-        return PIPER_ERR_GENERIC;
+        return timings;
     }
 
-    if (espeak_SetVoiceByName(synth->espeak_voice.c_str()) != EE_OK) {
-        return PIPER_ERR_GENERIC;
+    auto to_ms = [](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
+
+    timings.phonemize_ms = to_ms(synth->t_phonemize);
+    timings.run_ms = to_ms(synth->t_run);
+    timings.overhead_ms = to_ms(synth->t_next - synth->t_run);
+    timings.num_runs = synth->n_runs;
+
+    return timings;
+}
+
+void piper_reset_timings(piper_synthesizer *synth) {
+    if (!synth) {
+        return;
     }
 
-    // Clear state
-    while (!synth->phoneme_id_queue.empty()) {
-        synth->phoneme_id_queue.pop();
+    synth->t_phonemize = {};
+    synth->t_run = {};
+    synth->t_next = {};
+    synth->n_runs = 0;
+}
+
+// Runs one sentence on a worker thread. Session::Run is safe to call
+// concurrently; everything else the job touches is its own.
+static piper_sentence_job run_sentence(piper_synthesizer *synth,
+                                       piper_sentence_job job) {
+    std::vector<PhonemeId> &ids = job.sentence.ids;
+    job.lengths[0] = (int64_t)ids.size();
+
+    const int64_t ids_shape[] = {1, (int64_t)ids.size()};
+    const int64_t lengths_shape[] = {1};
+    const int64_t scales_shape[] = {3};
+    const int64_t sid_shape[] = {1};
+
+    std::array<Ort::Value, 4> inputs = {
+        Ort::Value::CreateTensor<int64_t>(synth->memory_info, ids.data(),
+                                          ids.size(), ids_shape, 2),
+        Ort::Value::CreateTensor<int64_t>(synth->memory_info, job.lengths, 1,
+                                          lengths_shape, 1),
+        Ort::Value::CreateTensor<float>(synth->memory_info, job.scales, 3,
+                                        scales_shape, 1),
+        Ort::Value{nullptr}};
+    std::array<const char *, 4> input_names = {"input", "input_lengths",
+                                               "scales", "sid"};
+    size_t num_inputs = 3;
+
+    if (synth->num_speakers > 1) {
+        inputs[3] = Ort::Value::CreateTensor<int64_t>(synth->memory_info,
+                                                      job.sid, 1, sid_shape, 1);
+        num_inputs = 4;
     }
-    synth->chunk_samples.clear();
 
-    std::unique_ptr<piper_synthesize_options> default_options;
-    if (!options) {
-        default_options = std::make_unique<piper_synthesize_options>(
-            piper_default_synthesize_options(synth));
-        options = default_options.get();
+    job.outputs = synth->session->Run(
+        Ort::RunOptions{nullptr}, input_names.data(), inputs.data(), num_inputs,
+        synth->output_name_ptrs.data(), synth->output_name_ptrs.size());
+
+    return job;
+}
+
+// Wraps the sentence content ids [begin, end) in BOS/EOS and adds them.
+// Every content id is followed by a pad and has three codepoints (id, pad,
+// separator), so id offsets map to codepoint offsets by 3/2.
+static void add_sentence(std::vector<piper_sentence> &sentences,
+                         const std::vector<Phoneme> &codepoints,
+                         const std::vector<PhonemeId> &ids, size_t begin,
+                         size_t end, bool crossfade_next) {
+    piper_sentence sentence;
+    sentence.phonemes.reserve((end - begin) / 2 * 3 + 5);
+    sentence.ids.reserve(end - begin + 3);
+
+    sentence.phonemes.push_back(PHONEME_BOS);
+    sentence.ids.push_back(ID_BOS);
+    sentence.phonemes.push_back(PHONEME_BOS);
+    sentence.ids.push_back(ID_PAD);
+    sentence.phonemes.push_back(PHONEME_SEPARATOR);
+
+    sentence.phonemes.insert(sentence.phonemes.end(),
+                             codepoints.begin() + begin / 2 * 3,
+                             codepoints.begin() + end / 2 * 3);
+    sentence.ids.insert(sentence.ids.end(), ids.begin() + begin,
+                        ids.begin() + end);
+
+    sentence.phonemes.push_back(PHONEME_EOS);
+    sentence.ids.push_back(ID_EOS);
+    sentence.phonemes.push_back(PHONEME_SEPARATOR);
+
+    sentence.crossfade_next = crossfade_next;
+    sentences.push_back(std::move(sentence));
+}
+
+// Returns the memoized sentences for key or nullptr
+static const std::vector<piper_sentence> *
+find_phonemized(piper_synthesizer *synth, const std::string &key) {
+    auto it = synth->phoneme_cache_index.find(key);
+    if (it == synth->phoneme_cache_index.end()) {
+        return nullptr;
     }
 
-    synth->length_scale = options->length_scale;
-    synth->noise_scale = options->noise_scale;
-    synth->noise_w_scale = options->noise_w_scale;
-    synth->speaker_id = options->speaker_id;
+    // Move to the front, iterators stay valid
+    synth->phoneme_cache.splice(synth->phoneme_cache.begin(),
+                                synth->phoneme_cache, it->second);
+    return &it->second->second;
+}
+
+static void insert_phonemized(piper_synthesizer *synth, const std::string &key,
+                              const std::vector<piper_sentence> &sentences) {
+    if (synth->phoneme_cache_size == 0) {
+        return;
+    }
+
+    synth->phoneme_cache.emplace_front(key, sentences);
+    synth->phoneme_cache_index[key] = synth->phoneme_cache.begin();
+
+    if (synth->phoneme_cache.size() > synth->phoneme_cache_size) {
+        synth->phoneme_cache_index.erase(synth->phoneme_cache.back().first);
+        synth->phoneme_cache.pop_back();
+    }
+}
+
+// Keeps parallel_sentences sentences in flight
+static void launch_sentences(piper_synthesizer *synth) {
+    while (!synth->phoneme_id_queue.empty() &&
+           synth->pending_sentences.size() <
+               (size_t)synth->parallel_sentences) {
+        piper_sentence_job job;
+        job.sentence = std::move(synth->phoneme_id_queue.front());
+        synth->phoneme_id_queue.pop();
+
+        job.scales[0] = synth->noise_scale;
+        job.scales[1] = synth->length_scale;
+        job.scales[2] = synth->noise_w_scale;
+        job.sid[0] = synth->speaker_id;
+
+        synth->pending_sentences.push_back(std::async(
+            std::launch::async, run_sentence, synth, std::move(job)));
+    }
+}
+
+// Turns text into sentences of phoneme ids, split into chunks of at most
+// max_chunk_phoneme_ids ids if that is positive. Sentences are appended.
+static int phonemize_text(piper_synthesizer *synth, const char *text,
+                          int max_chunk_phoneme_ids,
+                          std::vector<piper_sentence> &sentences) {
+    // Repeated prompts skip espeak, normalization and the id lookup. The key
+    // is the whole text since espeak decides where sentences end.
+    std::string cache_key = text;
+    cache_key += '\0';
+    cache_key += std::to_string(max_chunk_phoneme_ids);
+
+    if (const auto *cached = find_phonemized(synth, cache_key)) {
+        sentences.insert(sentences.end(), cached->begin(), cached->end());
+        return PIPER_OK;
+    }
 
     // phonemize
     std::vector<std::string> sentence_phonemes{""};
     std::size_t current_idx = 0;
     const void *text_ptr = text;
+
+    std::unique_lock<std::mutex> espeak_lock(espeak_mutex);
+    if (espeak_current_voice != synth->espeak_voice) {
+        if (espeak_SetVoiceByName(synth->espeak_voice.c_str()) != EE_OK) {
+            espeak_current_voice.clear();
+            return PIPER_ERR_GENERIC;
+        }
+        espeak_current_voice = synth->espeak_voice;
+    }
+
     while (text_ptr != nullptr) {
         int terminator = 0;
         std::string terminator_str = "";
@@ -196,22 +481,26 @@ int piper_synthesize_start(struct piper_synthesizer *synth, const char *text,
             current_idx = sentence_phonemes.size() - 1;
         }
     }
+    espeak_lock.unlock();
 
-    // phonemes to ids
+    // phonemes to ids, collected apart from the caller's sentences so that
+    // only this text's are memoized
+    std::vector<piper_sentence> text_sentences;
     std::vector<Phoneme> sentence_codepoints;
     std::vector<PhonemeId> sentence_ids;
+    std::vector<std::pair<size_t, bool>> sentence_breaks;
+    std::vector<Phoneme> phonemes;
+    std::vector<PhonemeIdTable::slot> phoneme_slots;
     for (auto &phonemes_str : sentence_phonemes) {
         if (phonemes_str.empty()) {
             continue;
         }
 
-        sentence_codepoints.push_back(PHONEME_BOS);
-        sentence_ids.push_back(ID_BOS);
-
-        sentence_codepoints.push_back(PHONEME_BOS);
-        sentence_ids.push_back(ID_PAD);
-
-        sentence_codepoints.push_back(PHONEME_SEPARATOR);
+        // Sentence content without BOS/EOS, see add_sentence
+        sentence_codepoints.clear();
+        sentence_ids.clear();
+        sentence_breaks.clear();
+        phonemes.clear();
 
         auto phonemes_norm = una::norm::to_nfd_utf8(phonemes_str);
         auto phonemes_range = una::ranges::utf8_view{phonemes_norm};
@@ -233,31 +522,143 @@ int piper_synthesize_start(struct piper_synthesizer *synth, const char *text,
                 // Start of (lang) switch
                 in_lang_flag = true;
             } else {
-                // Look up ids
-                auto ids_for_phoneme = synth->phoneme_id_map.find(phoneme);
-                if (ids_for_phoneme != synth->phoneme_id_map.end()) {
-                    for (auto id : ids_for_phoneme->second) {
-                        sentence_codepoints.push_back(phoneme);
-                        sentence_ids.push_back(id);
+                phonemes.push_back(phoneme);
+            }
+
+            phonemes_iter++;
+        }
+
+        // Look up ids for the whole sentence at once
+        phoneme_slots.resize(phonemes.size());
+        synth->phoneme_id_table.find_all(phonemes.data(), phonemes.size(),
+                                         phoneme_slots.data());
+
+        Phoneme last_phoneme = 0;
+        for (size_t i = 0; i < phonemes.size(); i++) {
+            const Phoneme phoneme = phonemes[i];
+            const PhonemeIdTable::slot slot = phoneme_slots[i];
+            if (slot.count == 0) {
+                // Not in the voice's phoneme_id_map
+                continue;
+            }
 
-                        sentence_codepoints.push_back(phoneme);
-                        sentence_ids.push_back(ID_PAD);
+            const PhonemeId *ids = synth->phoneme_id_table.ids(slot);
+            for (uint32_t j = 0; j < slot.count; j++) {
+                sentence_codepoints.push_back(phoneme);
+                sentence_ids.push_back(ids[j]);
 
-                        sentence_codepoints.push_back(PHONEME_SEPARATOR);
+                sentence_codepoints.push_back(phoneme);
+                sentence_ids.push_back(ID_PAD);
+
+                sentence_codepoints.push_back(PHONEME_SEPARATOR);
+            }
+
+            // Chunks may end after a word, preferably after a clause
+            if (phoneme == U' ') {
+                const bool after_clause = last_phoneme == U',' ||
+                                          last_phoneme == U':' ||
+                                          last_phoneme == U';';
+                sentence_breaks.emplace_back(sentence_ids.size(), after_clause);
+            }
+            last_phoneme = phoneme;
+        }
+
+        // Split the sentence so no chunk has more than max_chunk_phoneme_ids
+        // ids, which bounds the time until its first audio
+        const size_t num_ids = sentence_ids.size();
+        size_t begin = 0;
+        if (max_chunk_phoneme_ids > 0) {
+            // BOS, pad and EOS are added to each chunk; keep id/pad pairs
+            const size_t max_content =
+                (size_t)std::max(2, max_chunk_phoneme_ids - 3) & ~1;
+
+            while (num_ids - begin > max_content) {
+                const size_t limit = begin + max_content;
+                size_t clause_end = 0;
+                size_t word_end = 0;
+                for (const auto &[pos, after_clause] : sentence_breaks) {
+                    if (pos <= begin) {
+                        continue;
+                    }
+                    if (pos > limit) {
+                        break;
+                    }
+                    word_end = pos;
+                    if (after_clause) {
+                        clause_end = pos;
                     }
                 }
-            }
 
-            phonemes_iter++;
+                const size_t end =
+                    clause_end ? clause_end : (word_end ? word_end : limit);
+                add_sentence(text_sentences, sentence_codepoints,
+                             sentence_ids, begin, end, true);
+                begin = end;
+            }
         }
 
-        sentence_codepoints.push_back(PHONEME_EOS);
-        sentence_ids.push_back(ID_EOS);
-        sentence_codepoints.push_back(PHONEME_SEPARATOR);
+        add_sentence(text_sentences, sentence_codepoints, sentence_ids, begin,
+                     num_ids, false);
+    }
 
-        synth->phoneme_id_queue.emplace(
-            std::move(std::make_pair(sentence_codepoints, sentence_ids)));
-        sentence_ids.clear();
+    insert_phonemized(synth, cache_key, text_sentences);
+    sentences.insert(sentences.end(),
+                     std::make_move_iterator(text_sentences.begin()),
+                     std::make_move_iterator(text_sentences.end()));
+
+    return PIPER_OK;
+}
+
+int piper_synthesize_start(struct piper_synthesizer *synth, const char *text,
+                           const piper_synthesize_options *options) {
+    if (!synth) {
+        return PIPER_ERR_GENERIC;
+    }
+
+    const auto t_start = std::chrono::steady_clock::now();
+
+    // Clear state, waiting for sentences still running from the last text
+    synth->pending_sentences.clear();
+    while (!synth->phoneme_id_queue.empty()) {
+        synth->phoneme_id_queue.pop();
+    }
+    synth->chunk_outputs.clear();
+    synth->chunk_tail.clear();
+
+    std::unique_ptr<piper_synthesize_options> default_options;
+    if (!options) {
+        default_options = std::make_unique<piper_synthesize_options>(
+            piper_default_synthesize_options(synth));
+        options = default_options.get();
+    }
+
+    synth->length_scale = options->length_scale;
+    synth->noise_scale = options->noise_scale;
+    synth->noise_w_scale = options->noise_w_scale;
+    synth->speaker_id = options->speaker_id;
+    synth->max_chunk_phoneme_ids = options->max_chunk_phoneme_ids;
+
+    // Bound to the session, picked up by the next runs
+    synth->input_scales[0] = synth->noise_scale;
+    synth->input_scales[1] = synth->length_scale;
+    synth->input_scales[2] = synth->noise_w_scale;
+    synth->input_sid[0] = synth->speaker_id;
+
+    std::vector<piper_sentence> sentences;
+    const int result = phonemize_text(synth, text,
+                                      synth->max_chunk_phoneme_ids, sentences);
+    if (result != PIPER_OK) {
+        return result;
+    }
+
+    for (auto &sentence : sentences) {
+        synth->phoneme_id_queue.push(std::move(sentence));
+    }
+
+    synth->t_phonemize += std::chrono::steady_clock::now() - t_start;
+
+    if (synth->parallel_sentences > 1) {
+        launch_sentences(synth);
     }
 
     return PIPER_OK;
@@ -273,8 +674,10 @@ int piper_synthesize_next(struct piper_synthesizer *synth,
         return PIPER_ERR_GENERIC;
     }
 
+    const auto t_next_start = std::chrono::steady_clock::now();
+
     // Clear data from previous call
-    synth->chunk_samples.clear();
+    synth->chunk_outputs.clear();
     synth->chunk_phonemes.clear();
     synth->chunk_phoneme_ids.clear();
     synth->chunk_alignments.clear();
@@ -288,69 +691,63 @@ int piper_synthesize_next(struct piper_synthesizer *synth,
     chunk->alignments = nullptr;
     chunk->num_alignments = 0;
 
-    if (synth->phoneme_id_queue.empty()) {
-        // Empty final chunk
-        chunk->is_last = true;
-        return PIPER_DONE;
-    }
+    piper_sentence next;
 
-    // Process next list of phoneme ids
-    auto [next_phonemes, next_ids] = std::move(synth->phoneme_id_queue.front());
-    synth->phoneme_id_queue.pop();
+    if (synth->parallel_sentences > 1) {
+        if (synth->pending_sentences.empty()) {
+            // Empty final chunk
+            chunk->is_last = true;
+            return PIPER_DONE;
+        }
 
-    auto memoryInfo = Ort::MemoryInfo::CreateCpu(
-        OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+        // Sentences are delivered in text order. With parallel runs the
+        // session time overlaps, so run time here is the time spent waiting.
+        const auto t_run_start = std::chrono::steady_clock::now();
+        piper_sentence_job job = synth->pending_sentences.front().get();
+        synth->pending_sentences.pop_front();
+        synth->t_run += std::chrono::steady_clock::now() - t_run_start;
+        synth->n_runs++;
 
-    // Allocate
-    std::vector<int64_t> phoneme_id_lengths{(int64_t)next_ids.size()};
-    std::vector<float> scales{synth->noise_scale, synth->length_scale,
-                              synth->noise_w_scale};
-
-    std::vector<Ort::Value> input_tensors;
-    std::vector<int64_t> phoneme_ids_shape{1, (int64_t)next_ids.size()};
-    input_tensors.push_back(Ort::Value::CreateTensor<int64_t>(
-        memoryInfo, next_ids.data(), next_ids.size(), phoneme_ids_shape.data(),
-        phoneme_ids_shape.size()));
-
-    std::vector<int64_t> phoneme_id_lengths_shape{
-        (int64_t)phoneme_id_lengths.size()};
-    input_tensors.push_back(Ort::Value::CreateTensor<int64_t>(
-        memoryInfo, phoneme_id_lengths.data(), phoneme_id_lengths.size(),
-        phoneme_id_lengths_shape.data(), phoneme_id_lengths_shape.size()));
-
-    std::vector<int64_t> scales_shape{(int64_t)scales.size()};
-    input_tensors.push_back(Ort::Value::CreateTensor<float>(
-        memoryInfo, scales.data(), scales.size(), scales_shape.data(),
-        scales_shape.size()));
-
-    // Add speaker id.
-    // NOTE: These must be kept outside the "if" below to avoid being
-    // deallocated.
-    std::vector<int64_t> speaker_id{(int64_t)synth->speaker_id};
-    std::vector<int64_t> speaker_id_shape{(int64_t)speaker_id.size()};
+        next = std::move(job.sentence);
+        synth->chunk_outputs = std::move(job.outputs);
 
-    if (synth->num_speakers > 1) {
-        input_tensors.push_back(Ort::Value::CreateTensor<int64_t>(
-            memoryInfo, speaker_id.data(), speaker_id.size(),
-            speaker_id_shape.data(), speaker_id_shape.size()));
-    }
+        launch_sentences(synth);
+    } else {
+        if (synth->phoneme_id_queue.empty()) {
+            // Empty final chunk
+            chunk->is_last = true;
+            return PIPER_DONE;
+        }
 
-    // From export_onnx.py
-    std::array<const char *, 4> input_names = {"input", "input_lengths",
-                                               "scales", "sid"};
+        // Process next list of phoneme ids
+        next = std::move(synth->phoneme_id_queue.front());
+        synth->phoneme_id_queue.pop();
+
+        // Copy ids into the bound input buffer
+        const size_t num_ids = next.ids.size();
+        if (num_ids > synth->input_ids.capacity()) {
+            synth->input_ids.reserve(
+                std::max(num_ids, 2 * synth->input_ids.capacity()));
+        }
+        synth->input_ids.assign(next.ids.begin(), next.ids.end());
+        synth->input_lengths[0] = (int64_t)num_ids;
 
-    // Get all output names
-    std::vector<std::string> output_names_strs =
-        synth->session->GetOutputNames();
-    std::vector<const char *> output_names;
-    for (const auto &name : output_names_strs) {
-        output_names.push_back(name.c_str());
+        const int64_t ids_shape[] = {1, (int64_t)num_ids};
+        Ort::Value ids_tensor = Ort::Value::CreateTensor<int64_t>(
+            synth->memory_info, synth->input_ids.data(), num_ids, ids_shape, 2);
+        synth->io_binding->BindInput("input", ids_tensor);
+
+        // Infer
+        const auto t_run_start = std::chrono::steady_clock::now();
+        synth->session->Run(Ort::RunOptions{nullptr}, *synth->io_binding);
+        synth->t_run += std::chrono::steady_clock::now() - t_run_start;
+        synth->n_runs++;
+
+        synth->chunk_outputs = synth->io_binding->GetOutputValues();
     }
 
-    // Infer
-    auto output_tensors = synth->session->Run(
-        Ort::RunOptions{nullptr}, input_names.data(), input_tensors.data(),
-        input_tensors.size(), output_names.data(), output_names.size());
+    // Kept alive until the next call, chunk->samples points into it
+    auto &output_tensors = synth->chunk_outputs;
 
     if ((output_tensors.size() < 1) || (!output_tensors.front().IsTensor())) {
         return PIPER_ERR_GENERIC;
@@ -358,24 +755,45 @@ int piper_synthesize_next(struct piper_synthesizer *synth,
 
     auto audio_shape =
         output_tensors.front().GetTensorTypeAndShapeInfo().GetShape();
-    chunk->num_samples = audio_shape[audio_shape.size() - 1];
+    size_t num_samples = audio_shape[audio_shape.size() - 1];
+    float *samples = output_tensors.front().GetTensorMutableData<float>();
+
+    // Chunks of one sentence overlap by a short crossfade so there is no seam
+    // where the model's output restarts. The tail of the previous chunk was
+    // held back and is mixed into the head of this one, in place.
+    if (!synth->chunk_tail.empty()) {
+        const size_t num_fade = std::min(synth->chunk_tail.size(), num_samples);
+        for (size_t i = 0; i < num_fade; i++) {
+            const float w = (i + 0.5f) / num_fade;
+            samples[i] = synth->chunk_tail[i] * (1.0f - w) + samples[i] * w;
+        }
+        synth->chunk_tail.clear();
+    }
+
+    size_t num_held = 0;
+    const size_t num_crossfade =
+        (size_t)synth->sample_rate * CHUNK_CROSSFADE_MS / 1000;
+    if (next.crossfade_next && num_samples > 2 * num_crossfade) {
+        num_held = num_crossfade;
+        num_samples -= num_held;
+        synth->chunk_tail.assign(samples + num_samples,
+                                 samples + num_samples + num_held);
+    }
 
-    const float *audio_tensor_data =
-        output_tensors.front().GetTensorData<float>();
-    synth->chunk_samples.resize(chunk->num_samples);
-    std::copy(audio_tensor_data, audio_tensor_data + chunk->num_samples,
-              synth->chunk_samples.begin());
-    chunk->samples = synth->chunk_samples.data();
+    // No copy, the caller reads the output tensor directly
+    chunk->samples = samples;
+    chunk->num_samples = num_samples;
 
-    chunk->is_last = synth->phoneme_id_queue.empty();
+    chunk->is_last = synth->phoneme_id_queue.empty() &&
+                     synth->pending_sentences.empty();
 
     // Copy phonemes
-    synth->chunk_phonemes = std::move(next_phonemes);
+    synth->chunk_phonemes = std::move(next.phonemes);
     chunk->phonemes = synth->chunk_phonemes.data();
     chunk->num_phonemes = synth->chunk_phonemes.size();
 
     // Copy phoneme ids
-    for (auto phoneme_id : next_ids) {
+    for (auto phoneme_id : next.ids) {
         if (phoneme_id < std::numeric_limits<int>::min() ||
             phoneme_id > std::numeric_limits<int>::max()) {
             continue;
@@ -401,17 +819,187 @@ int piper_synthesize_next(struct piper_synthesizer *synth,
                 (int)(alignments_tensor_data[i] * synth->hop_length);
         }
 
+        // The held back samples are attributed to the final EOS
+        if (num_held > 0 && !synth->chunk_alignments.empty()) {
+            int &eos = synth->chunk_alignments.back();
+            eos = std::max(0, eos - (int)num_held);
+        }
+
         chunk->alignments = synth->chunk_alignments.data();
     }
 
-    // Clean up
-    for (std::size_t i = 0; i < output_tensors.size(); i++) {
-        Ort::detail::OrtRelease(output_tensors[i].release());
+    synth->t_next += std::chrono::steady_clock::now() - t_next_start;
+
+    return PIPER_OK;
+}
+
+int piper_synthesize_batch(struct piper_synthesizer *synth,
+                           const char *const *texts, size_t num_texts,
+                           const piper_synthesize_options *options,
+                           size_t max_batch_size,
+                           struct piper_audio_chunk *chunks) {
+    if (!synth || (num_texts > 0 && (!texts || !chunks))) {
+        return PIPER_ERR_GENERIC;
+    }
+
+    const auto t_start = std::chrono::steady_clock::now();
+
+    piper_synthesize_options default_options;
+    if (!options) {
+        default_options = piper_default_synthesize_options(synth);
+        options = &default_options;
+    }
+
+    if (max_batch_size == 0) {
+        max_batch_size = DEFAULT_BATCH_SIZE;
     }
 
-    for (std::size_t i = 0; i < input_tensors.size(); i++) {
-        Ort::detail::OrtRelease(input_tensors[i].release());
+    // Without alignments there is no way to tell where each sentence's
+    // audio ends in the padded output
+    if (synth->output_names.size() < 2) {
+        max_batch_size = 1;
     }
 
+    // Whole sentences of all texts, in text order
+    std::vector<piper_sentence> sentences;
+    std::vector<size_t> sentence_text;
+    for (size_t i = 0; i < num_texts; i++) {
+        const int result = phonemize_text(synth, texts[i], 0, sentences);
+        if (result != PIPER_OK) {
+            return result;
+        }
+        sentence_text.resize(sentences.size(), i);
+    }
+
+    const auto t_runs_start = std::chrono::steady_clock::now();
+    synth->t_phonemize += t_runs_start - t_start;
+
+    // Sentences of similar length share a batch, which keeps padding low
+    std::vector<size_t> by_length(sentences.size());
+    for (size_t i = 0; i < by_length.size(); i++) {
+        by_length[i] = i;
+    }
+    std::stable_sort(by_length.begin(), by_length.end(),
+                     [&](size_t a, size_t b) {
+                         return sentences[a].ids.size() <
+                                sentences[b].ids.size();
+                     });
+
+    std::vector<std::vector<float>> sentence_audio(sentences.size());
+    std::vector<PhonemeId> ids;
+    std::vector<int64_t> lengths;
+    std::vector<int64_t> sids;
+    float scales[3] = {options->noise_scale, options->length_scale,
+                       options->noise_w_scale};
+
+    for (size_t first = 0; first < by_length.size(); first += max_batch_size) {
+        const size_t batch_size =
+            std::min(max_batch_size, by_length.size() - first);
+        const size_t *batch = by_length.data() + first;
+
+        // Sorted, so the last sentence is the longest
+        const size_t max_len = sentences[batch[batch_size - 1]].ids.size();
+
+        ids.assign(batch_size * max_len, ID_PAD);
+        lengths.resize(batch_size);
+        for (size_t b = 0; b < batch_size; b++) {
+            const auto &sentence_ids = sentences[batch[b]].ids;
+            std::copy(sentence_ids.begin(), sentence_ids.end(),
+                      ids.begin() + b * max_len);
+            lengths[b] = (int64_t)sentence_ids.size();
+        }
+        sids.assign(batch_size, options->speaker_id);
+
+        const int64_t ids_shape[] = {(int64_t)batch_size, (int64_t)max_len};
+        const int64_t lengths_shape[] = {(int64_t)batch_size};
+        const int64_t scales_shape[] = {3};
+
+        std::array<Ort::Value, 4> inputs = {
+            Ort::Value::CreateTensor<int64_t>(synth->memory_info, ids.data(),
+                                              ids.size(), ids_shape, 2),
+            Ort::Value::CreateTensor<int64_t>(synth->memory_info,
+                                              lengths.data(), lengths.size(),
+                                              lengths_shape, 1),
+            Ort::Value::CreateTensor<float>(synth->memory_info, scales, 3,
+                                            scales_shape, 1),
+            Ort::Value{nullptr}};
+        std::array<const char *, 4> input_names = {"input", "input_lengths",
+                                                   "scales", "sid"};
+        size_t num_inputs = 3;
+
+        if (synth->num_speakers > 1) {
+            inputs[3] = Ort::Value::CreateTensor<int64_t>(
+                synth->memory_info, sids.data(), sids.size(), lengths_shape,
+                1);
+            num_inputs = 4;
+        }
+
+        const auto t_run_start = std::chrono::steady_clock::now();
+        std::vector<Ort::Value> outputs = synth->session->Run(
+            Ort::RunOptions{nullptr}, input_names.data(), inputs.data(),
+            num_inputs, synth->output_name_ptrs.data(),
+            synth->output_name_ptrs.size());
+        synth->t_run += std::chrono::steady_clock::now() - t_run_start;
+        synth->n_runs++;
+
+        if (outputs.empty() || !outputs.front().IsTensor()) {
+            return PIPER_ERR_GENERIC;
+        }
+
+        // Audio is [batch, 1, samples], padded to the longest sentence
+        const float *audio = outputs.front().GetTensorData<float>();
+        const size_t audio_stride =
+            outputs.front().GetTensorTypeAndShapeInfo().GetElementCount() /
+            batch_size;
+
+        if (batch_size == 1) {
+            sentence_audio[batch[0]].assign(audio, audio + audio_stride);
+            continue;
+        }
+
+        // Alignments are [batch, 1, ids] durations in frames; the padded
+        // ids past each sentence's length have no duration
+        const float *alignments = outputs[1].GetTensorData<float>();
+        const size_t alignments_stride =
+            outputs[1].GetTensorTypeAndShapeInfo().GetElementCount() /
+            batch_size;
+
+        for (size_t b = 0; b < batch_size; b++) {
+            const size_t num_ids =
+                std::min((size_t)lengths[b], alignments_stride);
+            float num_frames = 0.0f;
+            for (size_t j = 0; j < num_ids; j++) {
+                num_frames += alignments[b * alignments_stride + j];
+            }
+
+            const size_t num_samples = std::min(
+                audio_stride, (size_t)(num_frames * synth->hop_length + 0.5f));
+            const float *samples = audio + b * audio_stride;
+            sentence_audio[batch[b]].assign(samples, samples + num_samples);
+        }
+    }
+
+    // Put each text back together
+    synth->batch_audio.resize(num_texts);
+    for (size_t i = 0; i < num_texts; i++) {
+        synth->batch_audio[i].clear();
+    }
+    for (size_t i = 0; i < sentences.size(); i++) {
+        auto &text_audio = synth->batch_audio[sentence_text[i]];
+        text_audio.insert(text_audio.end(), sentence_audio[i].begin(),
+                          sentence_audio[i].end());
+    }
+
+    for (size_t i = 0; i < num_texts; i++) {
+        piper_audio_chunk &chunk = chunks[i];
+        chunk = {};
+        chunk.sample_rate = synth->sample_rate;
+        chunk.samples = synth->batch_audio[i].data();
+        chunk.num_samples = synth->batch_audio[i].size();
+        chunk.is_last = true;
+    }
+
+    synth->t_next += std::chrono::steady_clock::now() - t_runs_start;
+
     return PIPER_OK;
 }
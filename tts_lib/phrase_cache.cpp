@@ -0,0 +1,183 @@
+#include "phrase_cache.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char CACHE_MAGIC[4] = {'P', 'H', 'R', 'C'};
+const uint32_t CACHE_VERSION = 1;
+
+bool write_u32(FILE *f, uint32_t v) { return fwrite(&v, sizeof(v), 1, f) == 1; }
+bool write_u64(FILE *f, uint64_t v) { return fwrite(&v, sizeof(v), 1, f) == 1; }
+bool read_u32(FILE *f, uint32_t &v) { return fread(&v, sizeof(v), 1, f) == 1; }
+bool read_u64(FILE *f, uint64_t &v) { return fread(&v, sizeof(v), 1, f) == 1; }
+
+bool write_string(FILE *f, const std::string &s) {
+  return write_u32(f, (uint32_t)s.size()) &&
+         fwrite(s.data(), 1, s.size(), f) == s.size();
+}
+
+bool read_string(FILE *f, std::string &s) {
+  uint32_t n = 0;
+  if (!read_u32(f, n) || n > (1u << 20)) {
+    return false;
+  }
+  s.resize(n);
+  return fread(&s[0], 1, n, f) == n;
+}
+
+size_t entry_bytes(const std::vector<float> &samples) {
+  return samples.size() * sizeof(float);
+}
+
+}
+
+phrase_cache::phrase_cache(size_t budget_bytes) : m_budget(budget_bytes) {}
+
+void phrase_cache::set_budget(size_t budget_bytes) {
+  m_budget = budget_bytes;
+  evict();
+}
+
+const std::vector<float> *phrase_cache::find(const std::string &key) {
+  auto it = m_index.find(key);
+  if (it == m_index.end()) {
+    return nullptr;
+  }
+
+  // move to the front, iterators stay valid
+  m_entries.splice(m_entries.begin(), m_entries, it->second);
+  return &it->second->samples;
+}
+
+void phrase_cache::insert(const std::string &key, std::vector<float> samples) {
+  if (entry_bytes(samples) > m_budget) {
+    return;
+  }
+
+  auto it = m_index.find(key);
+  if (it != m_index.end()) {
+    m_bytes -= entry_bytes(it->second->samples);
+    m_entries.erase(it->second);
+    m_index.erase(it);
+  }
+
+  m_bytes += entry_bytes(samples);
+  m_entries.push_front({key, std::move(samples)});
+  m_index[key] = m_entries.begin();
+
+  evict();
+}
+
+void phrase_cache::clear() {
+  m_entries.clear();
+  m_index.clear();
+  m_bytes = 0;
+}
+
+void phrase_cache::evict() {
+  while (m_bytes > m_budget && !m_entries.empty()) {
+    const entry &e = m_entries.back();
+    m_bytes -= entry_bytes(e.samples);
+    m_index.erase(e.key);
+    m_entries.pop_back();
+  }
+}
+
+bool phrase_cache::save(const std::string &path, const std::string &tag) const {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f) {
+    fprintf(stderr, "ERROR: Failed to open %s for writing\n", path.c_str());
+    return false;
+  }
+
+  bool ok = fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), f) == sizeof(CACHE_MAGIC) &&
+            write_u32(f, CACHE_VERSION) && write_string(f, tag) &&
+            write_u32(f, (uint32_t)m_entries.size());
+
+  // least recently used first, so that loading restores the same order
+  for (auto it = m_entries.rbegin(); ok && it != m_entries.rend(); ++it) {
+    ok = write_string(f, it->key) && write_u64(f, it->samples.size()) &&
+         fwrite(it->samples.data(), sizeof(float), it->samples.size(), f) ==
+             it->samples.size();
+  }
+
+  ok = fclose(f) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "ERROR: Failed to write phrase cache %s\n", path.c_str());
+  }
+
+  return ok;
+}
+
+bool phrase_cache::load(const std::string &path, const std::string &tag) {
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) {
+    // a missing file just means nothing was saved yet
+    return false;
+  }
+
+  char magic[sizeof(CACHE_MAGIC)];
+  uint32_t version = 0;
+  std::string file_tag;
+  uint32_t n_entries = 0;
+
+  long file_size = -1;
+  if (fseek(f, 0, SEEK_END) == 0) {
+    file_size = ftell(f);
+  }
+
+  bool ok = file_size >= 0 && fseek(f, 0, SEEK_SET) == 0 &&
+            fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+            memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0 &&
+            read_u32(f, version) && version == CACHE_VERSION &&
+            read_string(f, file_tag) && read_u32(f, n_entries);
+
+  if (ok && file_tag != tag) {
+    fprintf(stderr, "WARNING: Phrase cache %s was written for another voice\n",
+            path.c_str());
+    fclose(f);
+    return false;
+  }
+
+  std::vector<entry> loaded;
+  for (uint32_t i = 0; ok && i < n_entries; i++) {
+    std::string key;
+    uint64_t n_samples = 0;
+    ok = read_string(f, key) && read_u64(f, n_samples);
+    if (!ok) {
+      break;
+    }
+
+    // a count past the end of the file or beyond the budget is not trusted
+    // (nor skipped over); the whole file is rejected
+    const long pos = ftell(f);
+    if (n_samples > m_budget / sizeof(float) || pos < 0 ||
+        n_samples > (uint64_t)(file_size - pos) / sizeof(float)) {
+      ok = false;
+      break;
+    }
+
+    std::vector<float> samples(n_samples);
+    ok = fread(samples.data(), sizeof(float), n_samples, f) == n_samples;
+    if (ok) {
+      loaded.push_back({std::move(key), std::move(samples)});
+    }
+  }
+
+  fclose(f);
+
+  if (!ok) {
+    fprintf(stderr, "WARNING: Phrase cache %s is truncated or corrupt\n",
+            path.c_str());
+    return false;
+  }
+
+  // nothing is inserted unless the whole file parsed
+  for (entry &e : loaded) {
+    insert(e.key, std::move(e.samples));
+  }
+
+  return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// LRU cache of synthesized PCM keyed by an opaque string (the caller folds
+// the text and synthesis options into it). Least recently used phrases are
+// evicted once the cached samples exceed the memory budget.
+class phrase_cache {
+public:
+  explicit phrase_cache(size_t budget_bytes = 0);
+
+  // 0 disables the cache
+  void set_budget(size_t budget_bytes);
+  size_t budget() const { return m_budget; }
+
+  size_t size_bytes() const { return m_bytes; }
+  size_t count() const { return m_entries.size(); }
+
+  // Returns nullptr on a miss. The samples stay valid until the next call
+  // that modifies the cache.
+  const std::vector<float> *find(const std::string &key);
+
+  // Phrases larger than the whole budget are not cached
+  void insert(const std::string &key, std::vector<float> samples);
+  void clear();
+
+  // tag identifies what produced the samples (voice, sample rate); load()
+  // rejects files written with a different tag. A file that is rejected or
+  // does not parse completely leaves the cache unchanged.
+  bool save(const std::string &path, const std::string &tag) const;
+  bool load(const std::string &path, const std::string &tag);
+
+private:
+  struct entry {
+    std::string key;
+    std::vector<float> samples;
+  };
+
+  void evict();
+
+  // front is the most recently used
+  std::list<entry> m_entries;
+  std::unordered_map<std::string, std::list<entry>::iterator> m_index;
+
+  size_t m_budget = 0;
+  size_t m_bytes = 0;
+};
@@ -1,29 +1,56 @@
 #pragma once
 #include <SDL.h>
-#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
-#include <mutex>
 
 // A simple SDL audio player for 32-bit float mono audio.
 // It queues audio data and plays it asynchronously.
+//
+// Queued audio lives in a fixed-capacity single-producer/single-consumer ring
+// buffer: play() is the only writer and the SDL audio callback the only
+// reader, so the callback never locks or allocates.
 class sdl_player {
 public:
     sdl_player();
     ~sdl_player();
 
     // Initializes the SDL audio subsystem and opens the default playback device.
+    // buffer_ms sets the ring capacity; play() blocks while the ring is full.
     // Returns false on failure.
-    bool init(int sample_rate);
+    bool init(int sample_rate, int buffer_ms = 10000);
 
-    // Queues a vector of audio samples for playback.
-    // This is thread-safe.
+    // Queues audio samples for playback.
+    // Only one thread may call play() at a time (single producer).
     void play(const std::vector<float>& audio_data);
+    void play(const float* samples, size_t n_samples);
 
+    // Zero-copy alternative to play(): returns a contiguous block of free ring
+    // space for up to n_wanted samples (blocking while the ring is full) for
+    // the caller to write into directly. commit_write(n) then queues the first
+    // n samples of the block. Returns nullptr if the device is not open.
+    // Same single-producer rule as play().
+    float* acquire_write(size_t n_wanted, size_t& n_acquired);
+    void commit_write(size_t n);
+
+    // Blocks until every queued sample has been handed to SDL. The callback
+    // signals once when the ring drains, so there is no polling.
     void wait_to_finish();
 
     // Returns true if audio is currently playing.
     bool is_playing() const;
 
+    // Number of times the callback ran dry before wait_to_finish() was called,
+    // i.e. audible gaps caused by the producer falling behind.
+    size_t underrun_count() const;
+
+    // Largest number of samples that were queued at once since init().
+    size_t high_water_mark() const;
+
+    // Ring capacity in samples.
+    size_t capacity() const;
+
 private:
     // This is the C-style callback that SDL will call.
     static void audio_callback_c(void* userdata, Uint8* stream, int len);
@@ -31,14 +58,31 @@ private:
     // The instance method that the C-style callback forwards to.
     void audio_callback(Uint8* stream, int len);
 
+    // Producer side: blocks until the callback has read up to read_target
+    void wait_for_read(size_t read_target);
+
     SDL_AudioDeviceID m_dev_id = 0;
 
-    // Buffer for queued audio data
-    std::vector<float> m_buffer;
-    size_t m_buffer_pos = 0;
+    // Ring storage, sized to a power of two in init() and never resized
+    std::vector<float> m_ring;
+    size_t m_mask = 0;
+
+    // Monotonic sample counters; the ring index is (pos & m_mask).
+    // m_write is only stored by play(), m_read only by the audio callback.
+    std::atomic<size_t> m_write{0};
+    std::atomic<size_t> m_read{0};
+
+    // Set by wait_to_finish() so the final drain is not counted as an underrun
+    std::atomic<bool> m_finishing{false};
+    // Audio thread only: true while the callback is in the middle of a stream
+    bool m_active = false;
+
+    std::atomic<size_t> m_underruns{0};
+    std::atomic<size_t> m_high_water{0};
 
-    // Mutex to protect buffer access from the main thread and audio thread
-    mutable std::mutex m_mutex;
-    std::condition_variable m_cond;
-    bool m_is_playing = false;
+    // Read position at which the callback posts m_sem (SIZE_MAX: nobody is
+    // waiting). The producer arms it before parking, either for free space or
+    // for the drain, and the callback posts once when m_read reaches it.
+    std::atomic<size_t> m_notify_read{SIZE_MAX};
+    SDL_sem* m_sem = nullptr;
 };
@@ -1,6 +1,7 @@
 #include "../include/sdl_player.hpp"
 #include <algorithm>
 #include <cstdio>
+#include <cstring>
 
 sdl_player::sdl_player() {
   // Constructor is empty, initialization happens in init()
@@ -14,9 +15,13 @@ sdl_player::~sdl_player() {
     SDL_PauseAudioDevice(m_dev_id, 1);
     SDL_CloseAudioDevice(m_dev_id);
   }
+
+  if (m_sem) {
+    SDL_DestroySemaphore(m_sem);
+  }
 }
 
-bool sdl_player::init(int sample_rate) {
+bool sdl_player::init(int sample_rate, int buffer_ms) {
   SDL_AudioSpec wanted_spec, have_spec;
   SDL_zero(wanted_spec);
 
@@ -27,6 +32,27 @@ bool sdl_player::init(int sample_rate) {
   wanted_spec.callback = audio_callback_c;
   wanted_spec.userdata = this;
 
+  // Allocate the ring before the device can call back into it
+  size_t n_ring = 1;
+  const size_t n_wanted =
+      std::max<size_t>(wanted_spec.samples, (size_t)sample_rate * buffer_ms / 1000);
+  while (n_ring < n_wanted) {
+    n_ring <<= 1;
+  }
+  m_ring.assign(n_ring, 0.0f);
+  m_mask = n_ring - 1;
+  m_write = 0;
+  m_read = 0;
+
+  if (!m_sem) {
+    m_sem = SDL_CreateSemaphore(0);
+    if (!m_sem) {
+      fprintf(stderr, "%s: Failed to create semaphore: %s\n", __func__,
+              SDL_GetError());
+      return false;
+    }
+  }
+
   m_dev_id =
       SDL_OpenAudioDevice(nullptr, SDL_FALSE, &wanted_spec, &have_spec, 0);
   if (m_dev_id == 0) {
@@ -42,31 +68,105 @@ bool sdl_player::init(int sample_rate) {
 }
 
 void sdl_player::play(const std::vector<float> &audio_data) {
-  if (audio_data.empty() || m_dev_id == 0) {
-    return;
+  play(audio_data.data(), audio_data.size());
+}
+
+void sdl_player::play(const float *samples, size_t n_samples) {
+  size_t n_written = 0;
+  while (n_written < n_samples) {
+    size_t n = 0;
+    float *dst = acquire_write(n_samples - n_written, n);
+    if (!dst) {
+      return;
+    }
+
+    memcpy(dst, samples + n_written, n * sizeof(float));
+    commit_write(n);
+    n_written += n;
+  }
+}
+
+float *sdl_player::acquire_write(size_t n_wanted, size_t &n_acquired) {
+  n_acquired = 0;
+  if (n_wanted == 0 || m_dev_id == 0) {
+    return nullptr;
   }
-  
-  std::lock_guard<std::mutex> lock(m_mutex);
 
-  if (!m_is_playing) {
-    m_buffer = audio_data;
-    m_buffer_pos = 0;
-  } else {
-    m_buffer.insert(m_buffer.end(), audio_data.begin(), audio_data.end());
+  m_finishing = false;
+
+  while (true) {
+    const size_t write_pos = m_write.load(std::memory_order_relaxed);
+    const size_t read_pos = m_read.load(std::memory_order_acquire);
+    const size_t n_free = m_ring.size() - (write_pos - read_pos);
+
+    if (n_free == 0) {
+      // Ring is full, park until the callback has consumed something
+      wait_for_read(read_pos + 1);
+      continue;
+    }
+
+    // Stop at the end of the ring so the block is contiguous
+    const size_t start = write_pos & m_mask;
+    n_acquired = std::min({n_wanted, n_free, m_ring.size() - start});
+    return &m_ring[start];
+  }
+}
+
+void sdl_player::commit_write(size_t n) {
+  if (n == 0) {
+    return;
   }
 
-  m_is_playing = true; // Set the flag
+  const size_t write_pos = m_write.load(std::memory_order_relaxed);
+
+  // Publish the samples to the audio thread
+  m_write.store(write_pos + n, std::memory_order_release);
+
+  const size_t n_queued = write_pos + n - m_read.load(std::memory_order_acquire);
+  if (n_queued > m_high_water.load(std::memory_order_relaxed)) {
+    m_high_water.store(n_queued, std::memory_order_relaxed);
+  }
 }
 
 bool sdl_player::is_playing() const {
-  return m_is_playing;
+  return m_read.load(std::memory_order_acquire) !=
+         m_write.load(std::memory_order_acquire);
 }
 
+size_t sdl_player::underrun_count() const { return m_underruns.load(); }
+
+size_t sdl_player::high_water_mark() const { return m_high_water.load(); }
+
+size_t sdl_player::capacity() const { return m_ring.size(); }
+
 void sdl_player::wait_to_finish() {
-  std::unique_lock<std::mutex> lock(m_mutex);
-  // The wait call will unlock the mutex and put the thread to sleep
-  // until the condition (m_is_playing == false) is met and it is notified.
-  m_cond.wait(lock, [this] { return !this->m_is_playing; });
+  if (m_dev_id == 0) {
+    return;
+  }
+
+  m_finishing = true;
+
+  // Only the producer writes, so the ring is drained once the callback has
+  // read up to the current write position
+  wait_for_read(m_write.load(std::memory_order_relaxed));
+}
+
+void sdl_player::wait_for_read(size_t read_target) {
+  // drop a post left over from an earlier wait whose target was reached
+  // before it blocked
+  while (SDL_SemTryWait(m_sem) == 0) {
+  }
+
+  // seq_cst store + load pair with the ones in audio_callback() so that
+  // either this thread sees the new read position or the callback sees the
+  // armed target
+  m_notify_read.store(read_target);
+
+  while (m_read.load() < read_target) {
+    SDL_SemWait(m_sem);
+  }
+
+  m_notify_read.store(SIZE_MAX);
 }
 
 // The static C-style callback that SDL understands
@@ -75,37 +175,45 @@ void sdl_player::audio_callback_c(void *userdata, Uint8 *stream, int len) {
   static_cast<sdl_player *>(userdata)->audio_callback(stream, len);
 }
 
-// The member function that does the real work
+// The member function that does the real work. Runs on the SDL audio thread:
+// no locks, no allocation; SDL_SemPost only when the producer is parked.
 void sdl_player::audio_callback(Uint8 *stream, int len) {
-  std::unique_lock<std::mutex> lock(m_mutex);
-
-  size_t bytes_to_copy = 0;
+  const size_t n_wanted = (size_t)len / sizeof(float);
+  const size_t read_pos = m_read.load(std::memory_order_relaxed);
+  const size_t write_pos = m_write.load(std::memory_order_acquire);
+  const size_t n = std::min(n_wanted, write_pos - read_pos);
 
-  // Are we currently playing something?
-  if (m_buffer_pos < m_buffer.size()) {
-    size_t bytes_remaining = (m_buffer.size() - m_buffer_pos) * sizeof(float);
-    bytes_to_copy = std::min((size_t)len, bytes_remaining);
+  if (n > 0) {
+    const size_t start = read_pos & m_mask;
+    const size_t n0 = std::min(n, m_ring.size() - start);
 
     // Copy our audio data to the SDL stream
-    memcpy(stream, (Uint8 *)m_buffer.data() + (m_buffer_pos * sizeof(float)),
-           bytes_to_copy);
-    m_buffer_pos += bytes_to_copy / sizeof(float);
+    memcpy(stream, &m_ring[start], n0 * sizeof(float));
+    memcpy(stream + n0 * sizeof(float), &m_ring[0], (n - n0) * sizeof(float));
+
+    m_read.store(read_pos + n);
+    m_active = true;
   }
 
-  // If we've finished playing, clear the buffer to free memory
-  if (m_buffer_pos >= m_buffer.size()) {
-    m_buffer.clear();
-    m_buffer_pos = 0;
+  if (n < n_wanted) {
+    if (m_active && !m_finishing) {
+      m_underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_active = false;
+  }
 
-    if (m_is_playing) {
-      m_is_playing = false;
-      lock.unlock();       // Unlock before notifying to avoid contention
-      m_cond.notify_one(); // Wake up the waiting thread
+  // Wake the producer once the position it waits for (free space or the
+  // drain) has been reached; the exchange makes sure it is posted only once
+  if (n > 0) {
+    size_t notify_read = m_notify_read.load();
+    if (read_pos + n >= notify_read &&
+        m_notify_read.compare_exchange_strong(notify_read, SIZE_MAX)) {
+      SDL_SemPost(m_sem);
     }
   }
 
   // Fill any remaining part of the SDL stream with silence
-  if (bytes_to_copy < (size_t)len) {
-    SDL_memset(stream + bytes_to_copy, 0, len - bytes_to_copy);
+  if (n < n_wanted) {
+    SDL_memset(stream + n * sizeof(float), 0, len - n * sizeof(float));
   }
 }
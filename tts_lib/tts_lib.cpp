@@ -1,7 +1,13 @@
 #include "tts_lib.hpp"
+#include "phrase_cache.hpp"
 #include "sdl_player.hpp"
 #include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <piper.h>
 #include <vector>
 
@@ -16,10 +22,237 @@ static const char *MODEL_PATH = TTS_MODEL_DIR "/en_US-hfc_male-medium.onnx";
 static const char *JSON_PATH = TTS_MODEL_DIR "/en_US-hfc_male-medium.onnx.json";
 static const char *ESPEAK_PATH = TTS_ESPEAK_DIR;
 
+namespace {
+
+const int SAMPLE_RATE = 22050; // Piper's sample rate
+const float TARGET_PEAK = 0.95f;
+
+// Longest piece of a sentence piper vocodes at once while streaming, about
+// 50 phonemes, so long sentences start playing after their first clause
+const int STREAM_CHUNK_PHONEME_IDS = 100;
+
+// About three minutes of 22.05 kHz audio
+const size_t DEFAULT_CACHE_BUDGET = 16 * 1024 * 1024;
+
+// Chunk-by-chunk replacement for whole-utterance peak normalization. The
+// running peak only grows, so the gain only ever goes down. Chunks can end
+// mid-sentence, so a lower gain is not stepped in at the chunk start: it ramps
+// linearly from the previous gain over as much of the chunk as possible while
+// keeping every sample within TARGET_PEAK.
+struct peak_limiter {
+  float peak = 0.0f;
+  float gain = 1.0f;
+
+  // gain at the start of the current chunk and the samples it ramps over
+  float ramp_from = 1.0f;
+  size_t ramp_len = 0;
+
+  // Folds the chunk into the running peak and plans the gain across it
+  void update(const float *samples, size_t n) {
+    const float old_peak = peak;
+    for (size_t i = 0; i < n; i++) {
+      peak = std::max(peak, std::abs(samples[i]));
+    }
+
+    ramp_from = gain;
+    gain = peak > 0.0f ? TARGET_PEAK / peak : 1.0f;
+
+    // no ramp into the first chunk, nothing was played at the old gain
+    ramp_len = 0;
+    if (old_peak == 0.0f || peak == old_peak) {
+      return;
+    }
+
+    // a sample above the old peak limits how late the ramp may arrive:
+    // gain_at(i) * a <= TARGET_PEAK, and at the new peak itself len = i + 1
+    const double drop = ramp_from - gain;
+    double len = (double)n;
+    for (size_t i = 0; i < n && (double)i < len; i++) {
+      const float a = std::abs(samples[i]);
+      if (a > old_peak) {
+        len = std::min(len, (i + 1) * drop / (ramp_from - TARGET_PEAK / a));
+      }
+    }
+    ramp_len = (size_t)len;
+  }
+
+  // Gain of sample i of the current chunk
+  float gain_at(size_t i) const {
+    if (i + 1 >= ramp_len) {
+      return gain;
+    }
+    return ramp_from + (gain - ramp_from) * (float)(i + 1) / ramp_len;
+  }
+
+  // Scales samples [offset, offset + n) of the current chunk from src into dst
+  void apply(const float *src, float *dst, size_t offset, size_t n) const {
+    for (size_t i = 0; i < n; i++) {
+      dst[i] = src[i] * gain_at(offset + i);
+    }
+  }
+
+  void process(float *samples, size_t n) {
+    update(samples, n);
+    apply(samples, samples, 0, n);
+  }
+};
+
+// Trims and collapses whitespace so that trivially different spellings of a
+// prompt share an entry, and appends the options that change the audio.
+std::string make_cache_key(const std::string &text,
+                           const piper_synthesize_options &opts) {
+  std::string key;
+  key.reserve(text.size() + 32);
+
+  for (unsigned char c : text) {
+    if (std::isspace(c)) {
+      if (!key.empty() && key.back() != ' ') {
+        key += ' ';
+      }
+    } else {
+      key += c;
+    }
+  }
+  if (!key.empty() && key.back() == ' ') {
+    key.pop_back();
+  }
+
+  char buf[64];
+  snprintf(buf, sizeof(buf), "|%d|%.3f|%.3f|%.3f", opts.speaker_id,
+           opts.length_scale, opts.noise_scale, opts.noise_w_scale);
+  key += buf;
+
+  return key;
+}
+
+// Tag of the persisted phrase cache. The config (sample rate, espeak voice,
+// phoneme map) is identified by a hash of its contents, the model by its size
+// and modification time, so a replaced voice at the same path does not replay
+// the old voice's audio.
+std::string voice_tag(const char *model_path, const char *config_path) {
+  uint64_t config_hash = 14695981039346656037ull; // FNV-1a
+  if (FILE *f = fopen(config_path, "rb")) {
+    unsigned char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+      for (size_t i = 0; i < n; i++) {
+        config_hash = (config_hash ^ buf[i]) * 1099511628211ull;
+      }
+    }
+    fclose(f);
+  }
+
+  std::error_code ec;
+  const uintmax_t model_size = std::filesystem::file_size(model_path, ec);
+  const auto model_mtime =
+      std::filesystem::last_write_time(model_path, ec).time_since_epoch();
+
+  char buf[96];
+  snprintf(buf, sizeof(buf), " size=%llu mtime=%lld config=%016llx rate=%d",
+           (unsigned long long)model_size, (long long)model_mtime.count(),
+           (unsigned long long)config_hash, SAMPLE_RATE);
+
+  return model_path + std::string(buf);
+}
+
+// Template assembly: piper pads every synthesized fragment with silence. It is
+// trimmed down to a short margin around the speech, and the fragment is faded
+// in and out over that margin so no splice starts or ends on a hard cut.
+// Fragments that meet inside a sentence are overlap-added; at punctuation they
+// are separated by a pause that fits it instead.
+const float SILENCE_LEVEL = 0.01f;
+const int TRIM_MARGIN_MS = 20;
+const int CROSSFADE_MS = 10;
+const int CLAUSE_PAUSE_MS = 150;
+const int SENTENCE_PAUSE_MS = 300;
+
+// The margin keeps quiet onsets and endings (a final "s") that stay below
+// SILENCE_LEVEL; the fades run over its outer n_fade samples.
+void trim_silence(std::vector<float> &pcm, size_t n_fade) {
+  const auto loud = [](float x) { return std::abs(x) > SILENCE_LEVEL; };
+
+  auto first = std::find_if(pcm.begin(), pcm.end(), loud);
+  auto last = std::find_if(pcm.rbegin(), pcm.rend(), loud).base();
+
+  if (first >= last) {
+    pcm.clear();
+    return;
+  }
+
+  const size_t n_margin = (size_t)SAMPLE_RATE * TRIM_MARGIN_MS / 1000;
+  first -= std::min(n_margin, (size_t)(first - pcm.begin()));
+  last += std::min(n_margin, (size_t)(pcm.end() - last));
+
+  pcm.erase(last, pcm.end());
+  pcm.erase(pcm.begin(), first);
+
+  n_fade = std::min(n_fade, pcm.size() / 2);
+  for (size_t i = 0; i < n_fade; i++) {
+    const float w = (float)(i + 1) / (n_fade + 1);
+    pcm[i] *= w;
+    pcm[pcm.size() - 1 - i] *= w;
+  }
+}
+
+// Pause between two fragments, 0 for a join inside a sentence. The
+// punctuation may end the first fragment or start the second ("{}, then").
+int pause_between(const std::string &prev, const std::string &next) {
+  const size_t i = prev.find_last_not_of(" \t\r\n");
+  const size_t j = next.find_first_not_of(" \t\r\n");
+  const char c = i != std::string::npos && std::ispunct((unsigned char)prev[i])
+                     ? prev[i]
+                     : (j != std::string::npos ? next[j] : ' ');
+
+  switch (c) {
+  case ',':
+  case ';':
+  case ':':
+    return CLAUSE_PAUSE_MS;
+  case '.':
+  case '!':
+  case '?':
+    return SENTENCE_PAUSE_MS;
+  default:
+    return 0;
+  }
+}
+
+// Appends next to out, both faded by trim_silence. Without a pause the first
+// n_fade samples of next are added onto the faded tail of out, where the two
+// linear fades sum to a crossfade; otherwise pause_ms of silence goes between.
+void splice(std::vector<float> &out, const std::vector<float> &next,
+            int pause_ms, size_t n_fade) {
+  if (pause_ms > 0) {
+    out.resize(out.size() + (size_t)SAMPLE_RATE * pause_ms / 1000, 0.0f);
+    out.insert(out.end(), next.begin(), next.end());
+    return;
+  }
+
+  n_fade = std::min({n_fade, out.size(), next.size()});
+  const size_t offset = out.size() - n_fade;
+
+  for (size_t i = 0; i < n_fade; i++) {
+    out[offset + i] += next[i];
+  }
+
+  out.insert(out.end(), next.begin() + n_fade, next.end());
+}
+
+}
+
 struct TTSEngine::Impl {
   piper_synthesizer *synth = nullptr;
   bool initialized = false;
+  bool streaming = true;
   sdl_player player;
+  phrase_cache cache{DEFAULT_CACHE_BUDGET};
+  std::string cache_tag;
+
+  bool synthesize(const std::string &text, const piper_synthesize_options &opts,
+                  bool play, std::vector<float> *pcm);
+  bool fragment(const std::string &text, const piper_synthesize_options &opts,
+                std::vector<float> &pcm);
+
   ~Impl() {
     if (synth) {
       piper_free(synth);
@@ -28,18 +261,19 @@ struct TTSEngine::Impl {
 };
 
 TTSEngine::TTSEngine() : impl(new Impl()) {
-  if (!impl->player.init(22050)) { // Piper's sample rate is 22050
+  if (!impl->player.init(SAMPLE_RATE)) {
       fprintf(stderr, "ERROR: Failed to initialize SDL player\n");
       return;
   }
 
-  impl->synth = piper_create(MODEL_PATH, JSON_PATH, ESPEAK_PATH);
+  impl->synth = piper_create(MODEL_PATH, JSON_PATH, ESPEAK_PATH, nullptr);
 
   if (!impl->synth) {
     fprintf(stderr, "ERROR: Failed to create piper synthesizer\n");
     return;
   }
 
+  impl->cache_tag = voice_tag(MODEL_PATH, JSON_PATH);
   impl->initialized = true;
 }
 
@@ -47,6 +281,94 @@ TTSEngine::~TTSEngine() { delete impl; }
 
 bool TTSEngine::is_initialized() const { return impl && impl->initialized; }
 
+void TTSEngine::set_streaming(bool enabled) {
+  if (impl) {
+    impl->streaming = enabled;
+  }
+}
+
+// Runs piper over text and peak-limits the result. With play set the audio is
+// handed to the player chunk by chunk in streaming mode. pcm, if not
+// null, receives the whole utterance as it was played.
+bool TTSEngine::Impl::synthesize(const std::string &text,
+                                 const piper_synthesize_options &opts,
+                                 bool play, std::vector<float> *pcm) {
+  const bool stream = play && streaming;
+
+  piper_synthesize_options run_opts = opts;
+  if (stream) {
+    run_opts.max_chunk_phoneme_ids = STREAM_CHUNK_PHONEME_IDS;
+  }
+  piper_synthesize_start(synth, text.c_str(), &run_opts);
+
+  std::vector<float> all_samples;
+  piper_audio_chunk chunk;
+  peak_limiter limiter;
+  size_t n_generated = 0;
+
+  if (pcm) {
+    pcm->clear();
+  }
+
+  while (piper_synthesize_next(synth, &chunk) != PIPER_DONE) {
+    n_generated += chunk.num_samples;
+
+    if (!stream) {
+      all_samples.insert(all_samples.end(), chunk.samples,
+                         chunk.samples + chunk.num_samples);
+      continue;
+    }
+
+    // chunk.samples points into piper's output tensor, so the scaled samples
+    // are written straight into the player's ring without a staging buffer
+    limiter.update(chunk.samples, chunk.num_samples);
+    const size_t n_cached = pcm ? pcm->size() : 0;
+    if (pcm) {
+      pcm->resize(n_cached + chunk.num_samples);
+    }
+
+    size_t n_written = 0;
+    while (n_written < chunk.num_samples) {
+      size_t n = 0;
+      float *dst = player.acquire_write(chunk.num_samples - n_written, n);
+      if (!dst) {
+        // no device, keep the cached copy complete anyway
+        if (pcm) {
+          limiter.apply(chunk.samples + n_written,
+                        pcm->data() + n_cached + n_written, n_written,
+                        chunk.num_samples - n_written);
+        }
+        break;
+      }
+
+      limiter.apply(chunk.samples + n_written, dst, n_written, n);
+      if (pcm) {
+        memcpy(pcm->data() + n_cached + n_written, dst, n * sizeof(float));
+      }
+
+      player.commit_write(n);
+      n_written += n;
+    }
+  }
+
+  if (n_generated == 0) {
+    fprintf(stderr, "WARNING: No audio generated\n");
+    return false;
+  }
+
+  if (!stream) {
+    limiter.process(all_samples.data(), all_samples.size());
+    if (play) {
+      player.play(all_samples);
+    }
+    if (pcm) {
+      *pcm = std::move(all_samples);
+    }
+  }
+
+  return true;
+}
+
 void TTSEngine::play(const std::string &text) {
   if (!impl || !impl->synth) {
     fprintf(stderr, "ERROR: TTS not initialized\n");
@@ -54,34 +376,157 @@ void TTSEngine::play(const std::string &text) {
   }
 
   piper_synthesize_options opts = piper_default_synthesize_options(impl->synth);
-  piper_synthesize_start(impl->synth, text.c_str(), &opts);
+  const std::string key = make_cache_key(text, opts);
 
-  std::vector<float> all_samples;
-  piper_audio_chunk chunk;
+  if (const std::vector<float> *cached = impl->cache.find(key)) {
+    impl->player.play(*cached);
+    impl->player.wait_to_finish();
+    return;
+  }
+
+  const bool cache = impl->cache.budget() > 0;
 
-  while (piper_synthesize_next(impl->synth, &chunk) != PIPER_DONE) {
-    all_samples.insert(all_samples.end(), chunk.samples,
-                       chunk.samples + chunk.num_samples);
+  std::vector<float> pcm;
+  if (!impl->synthesize(text, opts, true, cache ? &pcm : nullptr)) {
+    return;
   }
 
-  if (all_samples.empty()) {
-    fprintf(stderr, "WARNING: No audio generated\n");
+  if (cache) {
+    impl->cache.insert(key, std::move(pcm));
+  }
+
+  impl->player.wait_to_finish();
+}
+
+// Audio for one template fragment, trimmed and faded at both ends. Goes
+// through the phrase cache, so fixed fragments are only synthesized once.
+bool TTSEngine::Impl::fragment(const std::string &text,
+                               const piper_synthesize_options &opts,
+                               std::vector<float> &pcm) {
+  const std::string key = make_cache_key(text, opts);
+
+  if (const std::vector<float> *cached = cache.find(key)) {
+    pcm = *cached;
+  } else {
+    if (!synthesize(text, opts, false, &pcm)) {
+      return false;
+    }
+    cache.insert(key, pcm);
+  }
+
+  trim_silence(pcm, (size_t)SAMPLE_RATE * CROSSFADE_MS / 1000);
+  return !pcm.empty();
+}
+
+void TTSEngine::play_template(const std::string &tmpl,
+                              const std::string &slot) {
+  if (!impl || !impl->synth) {
+    fprintf(stderr, "ERROR: TTS not initialized\n");
     return;
   }
 
-  float max_val = 0.0f;
-  for (float s : all_samples) {
-    max_val = std::max(max_val, std::abs(s));
+  const size_t pos = tmpl.find("{}");
+  if (pos == std::string::npos) {
+    play(tmpl);
+    return;
   }
 
-  if (max_val > 0.0f) {
-    float scale = 0.95f / max_val;
-    for (float &s : all_samples) {
-      s *= scale;
+  piper_synthesize_options opts = piper_default_synthesize_options(impl->synth);
+
+  const std::string parts[] = {tmpl.substr(0, pos), slot,
+                               tmpl.substr(pos + 2)};
+  const size_t n_fade = (size_t)SAMPLE_RATE * CROSSFADE_MS / 1000;
+
+  std::vector<float> out;
+  std::vector<float> pcm;
+  size_t n_played = 0;
+  const std::string *prev = nullptr;
+
+  for (const std::string &part : parts) {
+    if (part.find_first_not_of(" \t\r\n") == std::string::npos ||
+        !impl->fragment(part, opts, pcm)) {
+      continue;
+    }
+
+    if (prev) {
+      splice(out, pcm, pause_between(*prev, part), n_fade);
+    } else {
+      out.swap(pcm);
+    }
+    prev = &part;
+
+    // the fixed prefix starts playing while the slot is being synthesized;
+    // only the faded tail the next fragment may be overlap-added onto is
+    // held back
+    if (out.size() > n_played + n_fade) {
+      impl->player.play(out.data() + n_played, out.size() - n_fade - n_played);
+      n_played = out.size() - n_fade;
     }
   }
 
-  impl->player.play(all_samples);
+  if (!prev) {
+    fprintf(stderr, "WARNING: No audio generated\n");
+    return;
+  }
 
+  impl->player.play(out.data() + n_played, out.size() - n_played);
   impl->player.wait_to_finish();
 }
+
+void TTSEngine::set_cache_budget(size_t bytes) {
+  if (impl) {
+    impl->cache.set_budget(bytes);
+  }
+}
+
+void TTSEngine::prewarm(const std::vector<std::string> &phrases) {
+  if (!impl || !impl->synth) {
+    fprintf(stderr, "ERROR: TTS not initialized\n");
+    return;
+  }
+
+  piper_synthesize_options opts = piper_default_synthesize_options(impl->synth);
+
+  std::vector<const char *> texts;
+  std::vector<std::string> keys;
+  for (const std::string &text : phrases) {
+    std::string key = make_cache_key(text, opts);
+    if (!impl->cache.find(key)) {
+      texts.push_back(text.c_str());
+      keys.push_back(std::move(key));
+    }
+  }
+
+  if (texts.empty()) {
+    return;
+  }
+
+  // Nothing is played, so the phrases go through piper in padded batches
+  std::vector<piper_audio_chunk> chunks(texts.size());
+  if (piper_synthesize_batch(impl->synth, texts.data(), texts.size(), &opts, 0,
+                             chunks.data()) != PIPER_OK) {
+    fprintf(stderr, "ERROR: Failed to synthesize phrases\n");
+    return;
+  }
+
+  for (size_t i = 0; i < chunks.size(); i++) {
+    if (chunks[i].num_samples == 0) {
+      fprintf(stderr, "WARNING: No audio generated for \"%s\"\n", texts[i]);
+      continue;
+    }
+
+    std::vector<float> pcm(chunks[i].samples,
+                           chunks[i].samples + chunks[i].num_samples);
+    peak_limiter limiter;
+    limiter.process(pcm.data(), pcm.size());
+    impl->cache.insert(keys[i], std::move(pcm));
+  }
+}
+
+bool TTSEngine::save_cache(const std::string &path) const {
+  return impl && impl->cache.save(path, impl->cache_tag);
+}
+
+bool TTSEngine::load_cache(const std::string &path) {
+  return impl && impl->cache.load(path, impl->cache_tag);
+}
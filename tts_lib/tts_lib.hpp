@@ -1,5 +1,7 @@
 #pragma once
+#include <cstddef>
 #include <string>
+#include <vector>
 
 class TTSEngine {
 public:
@@ -12,6 +14,34 @@ public:
   bool is_initialized() const;
   void play(const std::string &text);
 
+  // When enabled (the default) each sentence is handed to the player as soon
+  // as piper produces it, instead of waiting for the whole utterance. Long
+  // sentences are synthesized in clause-sized chunks so they start sooner.
+  void set_streaming(bool enabled);
+
+  // Plays a prompt template such as "Prepare to {}" with slot substituted for
+  // the "{}". The fixed fragments are synthesized once and cached; at runtime
+  // only the slot goes through piper. Each piece is trimmed and faded at its
+  // ends; pieces that meet inside a sentence ("Prepare to {}") are crossfaded
+  // and punctuation ("In 5 seconds, {}") gets a pause. Splices sound most
+  // natural at punctuation.
+  void play_template(const std::string &tmpl, const std::string &slot);
+
+  // Played phrases are kept in an LRU cache keyed by the whitespace-normalized
+  // text and synthesis options, so repeated prompts skip piper entirely.
+  // bytes is the PCM memory budget (16 MB by default); 0 disables the cache.
+  void set_cache_budget(size_t bytes);
+
+  // Synthesizes phrases into the cache without playing them, batching several
+  // phrases per piper run for throughput
+  void prewarm(const std::vector<std::string> &phrases);
+
+  // Persist the cache across runs. load_cache() returns false if the file is
+  // missing, corrupt or was written for another voice (a changed model or
+  // config file counts as another voice).
+  bool save_cache(const std::string &path) const;
+  bool load_cache(const std::string &path);
+
 private:
   struct Impl;
   Impl *impl;